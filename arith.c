@@ -184,3 +184,29 @@ void finish_encoder() {
 /* Finaliza el descodificador. */
 void finish_decoder() {
 }
+
+/* Punto de sincronizacin. Termina el intervalo actual como
+   finish_encoder() (incluyendo los "bits_to_follow" pendientes) y
+   rellena con ceros hasta los BIT_ACCURACY bits que el descodificador
+   lee por adelantado, de modo que ste puede descodificar todos los
+   smbolos anteriores sin necesitar ms datos. Despus se alinea la
+   salida y se empieza un intervalo nuevo. El modelo no se toca. */
+void sync_encoder() {
+  int i;
+  bits_to_follow += 1;
+  if (low<_0_25) bit_plus_follow(0);
+  else bit_plus_follow(1);
+  for (i = 2; i<BIT_ACCURACY; i++) {
+    put_bit(0);
+  }
+  sync_output();
+  init_encoder();
+}
+
+/* Tras el punto de sincronizacin, el descodificador ha ledo
+   exactamente los bits escritos por sync_encoder(). Se salta el
+   relleno y se carga el siguiente intervalo. */
+void sync_decoder() {
+  align_input();
+  init_decoder();
+}
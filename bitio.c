@@ -12,29 +12,121 @@ static int put_counter = 0;
 
 #define FEEDBACK 8192
 
+/* Los bits se empaquetan en cada byte empezando por el menos
+   significativo, pero get_bits() y put_bits() transfieren primero el
+   bit mas significativo del valor. "reversed[b]" es el byte "b" con
+   sus bits en orden inverso y permite mover varios bits de una vez
+   entre ambas representaciones. */
+static unsigned char reversed[256];
+static int reversed_ready = 0;
+
+static void init_reversed() {
+  int i, j;
+  for(i=0; i<256; i++) {
+    reversed[i] = 0;
+    for(j=0; j<8; j++)
+      if(i & (1<<j)) reversed[i] |= 0x80>>j;
+  }
+  reversed_ready = 1;
+}
+
+/* Numero de bits ya consumidos (o escritos) de un byte, a partir de
+   la mascara "bit_to_read" (o "bit_to_write"). */
+static int used_bits(int mask) {
+  int n = 0;
+  while(mask>1) {
+    mask >>= 1;
+    n++;
+  }
+  return n;
+}
+
+/* Bytes leidos por adelantado por peek_bits(), pendientes de
+   consumir. */
+static int lookahead[4];
+static int lookahead_head = 0;
+static int lookahead_count = 0;
+
+static int next_byte() {
+  int c;
+  if(lookahead_count==0) return getchar();
+  c = lookahead[lookahead_head];
+  lookahead_head = (lookahead_head+1) & 3;
+  lookahead_count--;
+  return c;
+}
+
 int get_bit() {
   int bit;
   if(bit_to_read==256) {
-    input_byte = getchar();
+    input_byte = next_byte();
     bit_to_read = 1;
   }
   bit = input_byte & bit_to_read;
   bit_to_read <<= 1;
   get_counter++;
-  if(!(get_counter%8192)) fprintf(stderr,".");
+  if(!(get_counter%FEEDBACK)) fprintf(stderr,".");
   return bit;
 }  
 
+/* Lee los bits de byte en byte: en cada iteracion se extraen todos
+   los bits que quedan en "input_byte" (o los que falten). */
 int get_bits(int number_of_bits_to_get) {
-  int i;
-  int s = (get_bit() ? 1:0);
-  for(i=1; i<number_of_bits_to_get; i++) {
-    s <<= 1;
-    s |= (get_bit() ? 1:0);
+  unsigned int s = 0;
+  int used, m;
+  if(!reversed_ready) init_reversed();
+  while(number_of_bits_to_get>0) {
+    if(bit_to_read==256) {
+      input_byte = next_byte();
+      bit_to_read = 1;
+    }
+    used = used_bits(bit_to_read);
+    m = 8 - used;
+    if(m>number_of_bits_to_get) m = number_of_bits_to_get;
+    s <<= m;
+    s |= (reversed[input_byte & 0xFF] >> (8-used-m)) & ((1<<m)-1);
+    bit_to_read <<= m;
+    number_of_bits_to_get -= m;
+    get_counter += m;
+    if((get_counter%FEEDBACK) < m) fprintf(stderr,".");
+  }
+  return s;
+}
+
+/* Devuelve los siguientes "number_of_bits_to_peek" bits (a lo sumo
+   24), igual que get_bits(), pero sin consumirlos. Solo se leen los
+   bytes necesarios para completarlos, que quedan pendientes para las
+   siguientes lecturas. */
+int peek_bits(int number_of_bits_to_peek) {
+  unsigned int s = 0;
+  int used, m, k = 0, byte = input_byte, mask = bit_to_read;
+  if(!reversed_ready) init_reversed();
+  while(number_of_bits_to_peek>0) {
+    if(mask==256) {
+      if(k==lookahead_count) {
+        lookahead[(lookahead_head+k) & 3] = getchar();
+        lookahead_count++;
+      }
+      byte = lookahead[(lookahead_head+k) & 3];
+      k++;
+      mask = 1;
+    }
+    used = used_bits(mask);
+    m = 8 - used;
+    if(m>number_of_bits_to_peek) m = number_of_bits_to_peek;
+    s <<= m;
+    s |= (reversed[byte & 0xFF] >> (8-used-m)) & ((1<<m)-1);
+    mask <<= m;
+    number_of_bits_to_peek -= m;
   }
   return s;
 }
 
+/* Consume los siguientes "number_of_bits_to_skip" bits. */
+void skip_bits(int number_of_bits_to_skip) {
+  get_bits(number_of_bits_to_skip);
+}
+
 void put_bit(int bit) {
   if(bit_to_write==256) {
     putchar(output_byte);
@@ -44,16 +136,53 @@ void put_bit(int bit) {
   if(bit) output_byte |= bit_to_write;
   bit_to_write <<= 1;
   put_counter++;
-  if(!(put_counter%8192)) fprintf(stderr,"o");
+  if(!(put_counter%FEEDBACK)) fprintf(stderr,"o");
 }
 
+/* Escribe los bits de byte en byte, como get_bits(). */
 void put_bits(int bits, int number_of_bits_to_put) {
-  int i;
-  for(i=number_of_bits_to_put-1; i>=0; i--) {
-    put_bit(bits & (1<<i));
+  unsigned int chunk;
+  int used, m;
+  if(!reversed_ready) init_reversed();
+  while(number_of_bits_to_put>0) {
+    if(bit_to_write==256) {
+      putchar(output_byte);
+      bit_to_write = 1;
+      output_byte = 0;
+    }
+    used = used_bits(bit_to_write);
+    m = 8 - used;
+    if(m>number_of_bits_to_put) m = number_of_bits_to_put;
+    number_of_bits_to_put -= m;
+    chunk = ((unsigned int)bits >> number_of_bits_to_put) & ((1<<m)-1);
+    output_byte |= reversed[chunk << (8-m)] << used;
+    bit_to_write <<= m;
+    put_counter += m;
+    if((put_counter%FEEDBACK) < m) fprintf(stderr,"o");
   }
 }
 
 void flush() {
   if(bit_to_write!=0) putchar(output_byte);
 }
+
+/* Descarta los bits que quedan por leer del byte actual, de modo que
+   la siguiente lectura empieza en un byte nuevo. */
+void align_input() {
+  bit_to_read = 256;
+}
+
+/* Escribe el byte actual si contiene algun bit, de modo que la
+   siguiente escritura empieza en un byte nuevo. */
+void align_output() {
+  if(bit_to_write!=1) putchar(output_byte);
+  bit_to_write = 1;
+  output_byte = 0;
+}
+
+/* Alinea la salida y entrega al receptor todo lo escrito hasta ahora,
+   sin esperar a que se llene el buffer de stdout. */
+void sync_output() {
+  align_output();
+  fflush(stdout);
+}
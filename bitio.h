@@ -1,6 +1,11 @@
 int  get_bit ();
 int  get_bits(int number_of_bits_to_get);
+int  peek_bits(int number_of_bits_to_peek);
+void skip_bits(int number_of_bits_to_skip);
 void put_bit (int bit);
 void put_bits(int bits, int number_of_bits_to_put);
 void flush   ();
+void align_input ();
+void align_output();
+void sync_output ();
 
@@ -54,12 +54,12 @@
 //  character's position to the decoder, so I append it to the end
 //  of each data block.
 //
-//  The sorting for this routine is done via conventional qsort().
-//  The STL capable version in BWT.CPP is neater, and in theory
-//  should run faster.  The comparison function here is nearly
-//  the same as that from BWT.CPP, but it isn't a template fn.  Also,
-//  instead of passing pointers into the buffer, the qsort() compare
-//  function gets indices.
+//  The sorting for this routine used to be done via conventional
+//  qsort(), which gets very slow on repetitive data.  It is now done
+//  by suffix_array() (suffix_array.c), the prefix-doubling sort that
+//  lzss also uses, asked to treat the end of the buffer as bigger
+//  than any character.  The order, and hence the output, is the
+//  same as with the old comparison function.
 //
 // Build Instructions
 // ------------------
@@ -90,6 +90,7 @@
 #include <io.h>
 #endif
 #include <limits.h>
+#include "suffix_array.h"
 
 #define _INFO_
 
@@ -109,63 +110,6 @@ long length;
 unsigned char buffer[ BLOCK_SIZE ];
 int indices[ BLOCK_SIZE + 1 ];
 
-//
-// The logic in unbwt.cpp depends upon the strings having been
-// sorted as unsigned characters.  Some versions of memcmp() sort
-// using *signed* characters.  When this is the case, I compare
-// using this special replacement version of memcmp().
-//
-int memcmp_signed;
-
-int unsigned_memcmp( void *p1, void *p2, unsigned int i )
-{
-    unsigned char *pc1 = (unsigned char *) p1;
-    unsigned char *pc2 = (unsigned char *) p2;
-    while ( i-- ) {
-        if ( *pc1 < *pc2 )
-            return -1;
-        else if ( *pc1++ > *pc2++ )
-            return 1;
-    }
-    return 0;
-}
-
-//
-// This is the special comparison function used when calling
-// qsort() to sort the array of indices into the buffer. Remember that
-// the character at buffer+length doesn't really exist, but it is assumed
-// to be the special end-of-buffer character, which is bigger than
-// any character found in the input buffer.  So I terminate the
-// comparison at the end of the buffer.
-//
-
-int
-#if defined( _MSC_VER )
-_cdecl
-#endif
-bounded_compare( const unsigned int *i1,
-                 const unsigned int *i2 )
-{
-    static int ticker = 0;
-    if ( ( ticker++ % 4096 ) == 0 )
-        fprintf( stderr, "." );
-    unsigned int l1 = (unsigned int) ( length - *i1 );
-    unsigned int l2 = (unsigned int) ( length - *i2 );
-    int result;
-    if ( memcmp_signed )
-        result = unsigned_memcmp( buffer + *i1,
-                                  buffer + *i2,
-                                  l1 < l2 ? l1 : l2 );
-    else
-        result = memcmp( buffer + *i1,
-                         buffer + *i2,
-                         l1 < l2 ? l1 : l2 );
-    if ( result == 0 )
-        return l2 - l1;
-    else
-        return result;
-};
-
 
 main( int argc, char *argv[] )
 {
@@ -198,13 +142,6 @@ main( int argc, char *argv[] )
     setmode( fileno( stdin ), O_BINARY );
     setmode( fileno( stdout ), O_BINARY );
 #endif
-    if ( memcmp( "\x070", "\x080", 1 ) < 0 ) {
-        memcmp_signed = 0;
-        fprintf( stderr, "memcmp() treats character data as unsigned\n" );
-    } else {
-        memcmp_signed = 1;
-        fprintf( stderr, "memcmp() treats character data as signed\n" );
-    }
 //
 // This is the start of the giant outer loop.  Each pass
 // through the loop compresses up to BLOCK_SIZE characters.
@@ -226,23 +163,16 @@ main( int argc, char *argv[] )
         long l = length + 1;
         fwrite( (char *) &l, 1, sizeof( long ), stdout );
 //
-// Sorting the input strings is simply a matter of inserting
-// the indices into the array, then calling qsort() with the
-// special bounded_compare() function I wrote to work with
-// these string types.  Note that I sort N+1 indices. The last index
+// Sorting the input strings is simply a matter of calling
+// suffix_array() on the buffer, with the end of the buffer sorting
+// after any character.  Note that I sort N+1 indices. The last index
 // points one past the end of the buffer, which is where the
-// imaginary end-of-buffer character resides.  Sort of.
+// imaginary end-of-buffer character resides.  Since that character
+// is the biggest one, the empty string it starts always sorts last.
 //
         int i;
-        for ( i = 0 ; i <= length ; i++ )
-            indices[ i ] = i;
-        qsort( indices,
-               (int)( length + 1 ),
-               sizeof( int ),
-               ( int (*)(const void *, const void *) ) bounded_compare );
-#ifdef _INFO_
-        fprintf( stderr, "\n" );
-#endif
+        suffix_array( buffer, (int) length, indices, END_LARGEST );
+        indices[ length ] = (int) length;
 //
 // If the debug flag was turned on, I print out the sorted
 // strings, along with their prefix characters.  This is
@@ -0,0 +1,351 @@
+/*
+ * canonical.c
+ *
+ * Cdigos de Huffman cannicos.
+ *
+ * En un cdigo de Huffman cannico los cdigos de cada longitud son
+ * enteros consecutivos, asignados en orden de smbolo, por lo que
+ * basta con conocer la longitud del cdigo de cada smbolo para
+ * reconstruir el cdigo completo. Las longitudes se calculan a partir
+ * de los recuentos de los smbolos y pueden limitarse a un nmero
+ * mximo de bits.
+ *
+ * Referencias:
+ *
+ * D. A. Huffman, Proceedings of the Institute of Radio Engineers,
+ * Vol. 40, pp. 1098-1101. 1952.
+ * J. van Leeuwen, "On the Construction of Huffman Trees," Proc. 3rd
+ * Int. Colloquium on Automata, Languages and Programming,
+ * pp. 382-410. 1976.
+ * L. L. Larmore and D. S. Hirschberg, "A Fast Algorithm for Optimal
+ * Length-Limited Huffman Codes," J. ACM, 37(3):464-473. 1990.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "canonical.h"
+
+/*
+ * Ordena por recuento creciente los smbolos de recuento no nulo,
+ * con una ordenacin por base (radix sort) de 8 bits en 8 bits, y
+ * devuelve su nmero. Cada pasada es estable, por lo que los smbolos
+ * de igual recuento quedan en orden de smbolo.
+ */
+static int sort_symbols(unsigned long *counts, int n, int *symbols) {
+  int tmp[CANONICAL_MAX_SYMBOLS], bucket[257];
+  unsigned long max_count = 0;
+  int m = 0, i, shift, *from = symbols, *to = tmp, *swap;
+
+  for ( i = 0 ; i < n ; i++ )
+    if ( counts[ i ] ) {
+      symbols[ m++ ] = i;
+      if ( counts[ i ] > max_count )
+	max_count = counts[ i ];
+    }
+  for ( shift = 0 ; ( max_count >> shift ) > 0 ; shift += 8 ) {
+    memset(bucket, 0, sizeof(bucket));
+    for ( i = 0 ; i < m ; i++ )
+      bucket[ ( ( counts[ from[ i ] ] >> shift ) & 0xFF ) + 1 ]++;
+    for ( i = 1 ; i < 257 ; i++ )
+      bucket[ i ] += bucket[ i - 1 ];
+    for ( i = 0 ; i < m ; i++ )
+      to[ bucket[ ( counts[ from[ i ] ] >> shift ) & 0xFF ]++ ] = from[ i ];
+    swap = from;
+    from = to;
+    to = swap;
+  }
+  if ( from != symbols )
+    memcpy(symbols, from, m * sizeof(int));
+  return m;
+}
+
+/*
+ * Calcula las longitudes de un cdigo de Huffman (sin lmite) para
+ * los "m" smbolos de "symbols", ordenados por recuento creciente, y
+ * devuelve la mayor de ellas. Se usan dos colas: la de las hojas, ya
+ * ordenada, y la de los nodos internos, que se crean en orden de peso
+ * creciente. Los dos nodos de menor peso estn siempre al principio
+ * de alguna de las dos colas, por lo que el rbol se construye en
+ * tiempo lineal. Los nodos 0..m-1 son las hojas y m..2m-2 los
+ * internos; la profundidad de cada nodo se obtiene a partir de la de
+ * su padre, recorriendo los nodos internos desde la raz.
+ */
+static int huffman_lengths(unsigned long *counts, int *symbols, int m,
+		    int *lengths) {
+  unsigned long long weight[2*CANONICAL_MAX_SYMBOLS];
+  int parent[2*CANONICAL_MAX_SYMBOLS], depth[2*CANONICAL_MAX_SYMBOLS];
+  int leaf, node, next, k, child, max_length;
+
+  for ( leaf = 0 ; leaf < m ; leaf++ )
+    weight[ leaf ] = counts[ symbols[ leaf ] ];
+  leaf = 0;
+  node = m;
+  for ( next = m ; next < 2*m - 1 ; next++ ) {
+    weight[ next ] = 0;
+    for ( k = 0 ; k < 2 ; k++ ) {
+      if ( leaf < m && ( node >= next || weight[ leaf ] <= weight[ node ] ) )
+	child = leaf++;
+      else
+	child = node++;
+      parent[ child ] = next;
+      weight[ next ] += weight[ child ];
+    }
+  }
+  depth[ 2*m - 2 ] = 0;
+  for ( node = 2*m - 3 ; node >= 0 ; node-- )
+    depth[ node ] = depth[ parent[ node ] ] + 1;
+  max_length = 0;
+  for ( leaf = 0 ; leaf < m ; leaf++ ) {
+    lengths[ symbols[ leaf ] ] = depth[ leaf ];
+    if ( depth[ leaf ] > max_length )
+      max_length = depth[ leaf ];
+  }
+  return max_length;
+}
+
+/*
+ * Calcula las longitudes de un cdigo prefijo ptimo con la
+ * restriccin de que ningn cdigo supere "max_length" bits,
+ * usando el algoritmo "package-merge". Se construyen "max_length"
+ * listas, desde el nivel ms profundo hasta la raz: la ms profunda
+ * contiene las hojas ordenadas por recuento y cada una de las
+ * siguientes es la mezcla ordenada de las hojas con los "paquetes"
+ * formados por parejas consecutivas de la lista anterior. De la
+ * lista de la raz se seleccionan los 2m-2 primeros elementos y la
+ * longitud del cdigo de una hoja es el nmero de niveles en los que
+ * resulta seleccionada. Como en cada nivel las hojas seleccionadas
+ * son siempre las de menor recuento, basta con contar cuntas hojas
+ * hay entre los elementos seleccionados de cada lista.
+ */
+static void package_merge(unsigned long *counts, int *symbols, int m,
+		   int *lengths, int max_length) {
+  unsigned long long weight[2][2*CANONICAL_MAX_SYMBOLS];
+  unsigned char is_leaf[CANONICAL_MAX_LENGTH + 1][2*CANONICAL_MAX_SYMBOLS];
+  int list_size[CANONICAL_MAX_LENGTH + 1];
+  int i, level, leaf, package, size, packages, selected, leaves;
+  unsigned long long *prev, *curr;
+
+  for ( i = 0 ; i < m ; i++ )
+    lengths[ symbols[ i ] ] = 0;
+  /* Nivel ms profundo: slo hojas. */
+  prev = weight[ 0 ];
+  for ( i = 0 ; i < m ; i++ ) {
+    prev[ i ] = counts[ symbols[ i ] ];
+    is_leaf[ max_length ][ i ] = 1;
+  }
+  list_size[ max_length ] = m;
+  for ( level = max_length - 1 ; level >= 1 ; level-- ) {
+    curr = weight[ (max_length - level) & 1 ];
+    packages = list_size[ level + 1 ] / 2;
+    leaf = package = size = 0;
+    while ( leaf < m || package < packages ) {
+      if ( package >= packages ||
+	   ( leaf < m && counts[ symbols[ leaf ] ] <=
+	     prev[ 2*package ] + prev[ 2*package + 1 ] ) ) {
+	curr[ size ] = counts[ symbols[ leaf++ ] ];
+	is_leaf[ level ][ size++ ] = 1;
+      } else {
+	curr[ size ] = prev[ 2*package ] + prev[ 2*package + 1 ];
+	package++;
+	is_leaf[ level ][ size++ ] = 0;
+      }
+    }
+    list_size[ level ] = size;
+    prev = curr;
+  }
+
+  /* Seleccin de los 2m-2 primeros elementos de la lista de la raz,
+     y de los elementos de las listas inferiores que forman parte de
+     los paquetes seleccionados. */
+  selected = 2*m - 2;
+  for ( level = 1 ; level <= max_length && selected > 0 ; level++ ) {
+    leaves = 0;
+    for ( i = 0 ; i < selected ; i++ )
+      leaves += is_leaf[ level ][ i ];
+    for ( i = 0 ; i < leaves ; i++ )
+      lengths[ symbols[ i ] ]++;
+    selected = 2*(selected - leaves);
+  }
+}
+
+/*
+ * Calcula las longitudes de los cdigos de los "n" primeros smbolos
+ * a partir de sus recuentos exactos. Normalmente basta con el cdigo
+ * de Huffman; slo si algn cdigo supera "max_length" bits se recurre
+ * a package-merge.
+ */
+void compute_lengths(unsigned long *counts, int n, int *lengths,
+		     int max_length) {
+  int symbols[CANONICAL_MAX_SYMBOLS];
+  int i, m;
+
+  for ( i = 0 ; i < n ; i++ )
+    lengths[ i ] = 0;
+  m = sort_symbols(counts, n, symbols);
+  if ( m == 0 )
+    return;
+  if ( m == 1 ) {
+    lengths[ symbols[ 0 ] ] = 1;
+    return;
+  }
+  if ( huffman_lengths(counts, symbols, m, lengths) > max_length )
+    package_merge(counts, symbols, m, lengths, max_length);
+}
+
+/*
+ * Asigna los cdigos cannicos a partir de las longitudes. Los
+ * cdigos ms cortos son numricamente menores y, dentro de cada
+ * longitud, se asignan en orden de smbolo.
+ */
+void assign_canonical_codes(int *lengths, int n, CODE *codes) {
+  int length_count[CANONICAL_MAX_LENGTH + 2];
+  unsigned int next_code[CANONICAL_MAX_LENGTH + 2];
+  unsigned int code;
+  int i;
+  for ( i = 0 ; i <= CANONICAL_MAX_LENGTH + 1 ; i++ )
+    length_count[ i ] = 0;
+  for ( i = 0 ; i < n ; i++ )
+    length_count[ lengths[ i ] ]++;
+  length_count[ 0 ] = 0;
+  code = 0;
+  for ( i = 1 ; i <= CANONICAL_MAX_LENGTH + 1 ; i++ ) {
+    code = ( code + length_count[ i - 1 ] ) << 1;
+    next_code[ i ] = code;
+  }
+  for ( i = 0 ; i < n ; i++ ) {
+    codes[ i ].code_bits = lengths[ i ];
+    codes[ i ].code = lengths[ i ] ? next_code[ lengths[ i ] ]++ : 0;
+  }
+}
+
+unsigned int reverse_bits(unsigned int code, int length) {
+  unsigned int r = 0;
+  while ( length-- ) {
+    r = ( r << 1 ) | ( code & 1 );
+    code >>= 1;
+  }
+  return r;
+}
+
+/*
+ * Construye una tabla de descodificacin de "table_bits" bits (al
+ * menos la longitud del cdigo ms largo), que se indexa con los
+ * "table_bits" bits siguientes del code-stream. Con LSB_FIRST el
+ * primer bit de un cdigo ocupa el bit 0 del ndice, por lo que un
+ * cdigo "c" de longitud "l" aparece en todas las entradas cuyos "l"
+ * bits menos significativos son "c" invertido; con MSB_FIRST aparece
+ * en las entradas cuyos "l" bits ms significativos son "c". Primero
+ * se rellena la tabla con un nico smbolo por entrada y despus, si
+ * los bits que quedan en el ndice tras el primer cdigo contienen un
+ * segundo cdigo completo, se aade ste a la entrada.
+ */
+void build_decoding_table(int *lengths, int n, unsigned int *table,
+			  int table_bits, int order) {
+  CODE codes[CANONICAL_MAX_SYMBOLS];
+  unsigned int size = 1u << table_bits, step, i, index, e, rest;
+  int s, l1, l2;
+
+  assign_canonical_codes(lengths, n, codes);
+  for ( s = 0 ; s < n ; s++ ) {
+    if ( lengths[ s ] == 0 )
+      continue;
+    if ( order == LSB_FIRST ) {
+      step = 1 << lengths[ s ];
+      for ( index = reverse_bits(codes[ s ].code, lengths[ s ]) ;
+	    index < size ; index += step )
+	table[ index ] = ENTRY(s, 0, lengths[ s ], lengths[ s ], 1);
+    } else {
+      step = 1 << ( table_bits - lengths[ s ] );
+      index = codes[ s ].code << ( table_bits - lengths[ s ] );
+      for ( i = 0 ; i < step ; i++ )
+	table[ index + i ] = ENTRY(s, 0, lengths[ s ], lengths[ s ], 1);
+    }
+  }
+  for ( i = 0 ; i < size ; i++ ) {
+    e = table[ i ];
+    l1 = ENTRY_LENGTH_1(e);
+    if ( order == LSB_FIRST )
+      rest = table[ i >> l1 ];
+    else
+      rest = table[ ( i << l1 ) & ( size - 1 ) ];
+    l2 = ENTRY_LENGTH_1(rest);
+    if ( l1 + l2 <= table_bits )
+      table[ i ] = ENTRY(ENTRY_SYMBOL_1(e), ENTRY_SYMBOL_1(rest),
+			 l1, l1 + l2, 2);
+  }
+}
+
+/*
+ * Las longitudes de los cdigos se transmiten como en Deflate, con
+ * un alfabeto de 19 smbolos de 5 bits:
+ *
+ *  0-15: una longitud
+ *    16: repite la longitud anterior de 3 a 6 veces (2 bits ms)
+ *    17: repite la longitud 0 de 3 a 10 veces (3 bits ms)
+ *    18: repite la longitud 0 de 11 a 138 veces (7 bits ms)
+ *
+ * "put" y "get" escriben y leen los bits (p. ej. put_bits() y
+ * get_bits()).
+ */
+#define LENGTH_SYMBOL_BITS 5
+#define REPEAT_PREVIOUS 16
+#define REPEAT_ZERO 17
+#define REPEAT_ZERO_LONG 18
+
+void output_lengths(int *lengths, int n, void (*put)(int, int)) {
+  int i, run, r;
+  for ( i = 0 ; i < n ; i += run ) {
+    for ( run = 1 ; i + run < n && lengths[ i + run ] == lengths[ i ] ; run++ )
+      ;
+    r = run;
+    if ( lengths[ i ] == 0 ) {
+      for ( ; r >= 11 ; r -= r < 138 ? r : 138 ) {
+	put(REPEAT_ZERO_LONG, LENGTH_SYMBOL_BITS);
+	put(( r < 138 ? r : 138 ) - 11, 7);
+      }
+      for ( ; r >= 3 ; r -= r < 10 ? r : 10 ) {
+	put(REPEAT_ZERO, LENGTH_SYMBOL_BITS);
+	put(( r < 10 ? r : 10 ) - 3, 3);
+      }
+    } else {
+      put(lengths[ i ], LENGTH_SYMBOL_BITS);
+      for ( r-- ; r >= 3 ; r -= r < 6 ? r : 6 ) {
+	put(REPEAT_PREVIOUS, LENGTH_SYMBOL_BITS);
+	put(( r < 6 ? r : 6 ) - 3, 2);
+      }
+    }
+    for ( ; r > 0 ; r-- )
+      put(lengths[ i ], LENGTH_SYMBOL_BITS);
+  }
+}
+
+void input_lengths(int *lengths, int n, int (*get)(int)) {
+  int i = 0, symbol, run, length;
+  while ( i < n ) {
+    symbol = get(LENGTH_SYMBOL_BITS);
+    if ( symbol < REPEAT_PREVIOUS ) {
+      lengths[ i++ ] = symbol;
+      continue;
+    }
+    if ( symbol == REPEAT_PREVIOUS && i > 0 ) {
+      run = 3 + get(2);
+      length = lengths[ i - 1 ];
+    } else if ( symbol == REPEAT_ZERO ) {
+      run = 3 + get(3);
+      length = 0;
+    } else if ( symbol == REPEAT_ZERO_LONG ) {
+      run = 11 + get(7);
+      length = 0;
+    } else {
+      fprintf(stderr, "canonical: longitudes de cdigo incorrectas\n");
+      exit(1);
+    }
+    if ( i + run > n ) {
+      fprintf(stderr, "canonical: longitudes de cdigo incorrectas\n");
+      exit(1);
+    }
+    while ( run-- )
+      lengths[ i++ ] = length;
+  }
+}
@@ -0,0 +1,55 @@
+/*
+ * canonical.h
+ *
+ * Cdigos de Huffman cannicos: clculo de las longitudes de los
+ * cdigos (con un lmite opcional), asignacin de los cdigos y
+ * tablas de descodificacin.
+ */
+
+/* Nmero mximo de smbolos y longitud mxima de un cdigo. */
+#define CANONICAL_MAX_SYMBOLS 257
+#define CANONICAL_MAX_LENGTH 15
+
+/* Orden de los bits de un cdigo en el ndice de una tabla de
+   descodificacin: el primer bit en la posicin menos significativa
+   (como en los bytes de bitio) o en la ms significativa (como en el
+   valor devuelto por get_bits() y peek_bits()). */
+#define LSB_FIRST 0
+#define MSB_FIRST 1
+
+/*
+ * Cada CODE contiene el cdigo de un smbolo y su longitud.
+ */
+typedef struct code {
+  unsigned int code;
+  int code_bits;
+} CODE;
+
+/*
+ * Cada entrada de una tabla de descodificacin contiene hasta dos
+ * smbolos completos:
+ *
+ *  bits  0- 8: primer smbolo
+ *  bits  9-17: segundo smbolo
+ *  bits 18-21: longitud del primer cdigo
+ *  bits 22-26: bits consumidos por la entrada
+ *  bits 27-28: nmero de smbolos de la entrada
+ */
+#define ENTRY(s1, s2, l1, l, n) \
+  ( (s1) | ( (s2) << 9 ) | ( (l1) << 18 ) | ( (l) << 22 ) | ( (n) << 27 ) )
+#define ENTRY_SYMBOL_1(e) ( (e) & 0x1FF )
+#define ENTRY_SYMBOL_2(e) ( ( (e) >> 9 ) & 0x1FF )
+#define ENTRY_LENGTH_1(e) ( ( (e) >> 18 ) & 0xF )
+#define ENTRY_LENGTH(e)   ( ( (e) >> 22 ) & 0x1F )
+#define ENTRY_SYMBOLS(e)  ( (e) >> 27 )
+
+void compute_lengths(unsigned long *counts, int n, int *lengths,
+		     int max_length);
+void assign_canonical_codes(int *lengths, int n, CODE *codes);
+unsigned int reverse_bits(unsigned int code, int length);
+void build_decoding_table(int *lengths, int n, unsigned int *table,
+			  int table_bits, int order);
+
+/* Transmisin de las longitudes de los cdigos, como en Deflate. */
+void output_lengths(int *lengths, int n, void (*put)(int, int));
+void input_lengths(int *lengths, int n, int (*get)(int));
@@ -0,0 +1,211 @@
+/*
+ * dict_train.c
+ *
+ * Construye un diccionario predefinido (ver dictionary.c) a partir de
+ * un conjunto de muestras, para comprimir registros pequeos con
+ * "lzss -D" y "lzw15v -D".
+ *
+ * Se usa el mtodo de cobertura (COVER) de zstd: el diccionario se
+ * forma con segmentos de "k" bytes de las muestras, elegidos para que
+ * contengan los "d-mers" (cadenas de "d" bytes) que aparecen en ms
+ * muestras. Las muestras se dividen en pocas, tantas como segmentos
+ * caben en el diccionario, y de cada poca se toma el segmento cuya
+ * suma de frecuencias de d-mers (distintos) es mayor. Los d-mers de
+ * un segmento elegido dejan de puntuar, para que el diccionario no
+ * repita contenido. El primer segmento elegido (el mejor) se coloca
+ * al final del diccionario, que es donde los compresores lo
+ * encuentran ms cerca de los datos.
+ *
+ * Referencias:
+ *
+ * A. Liao, R. Petri, A. Moffat and A. Wirth, "Effective Construction
+ * of Relative Lempel-Ziv Dictionaries," WWW 2016, pp. 807-816. 2016.
+ *
+ * Uso:
+ *
+ * dict_train [-s tamao] [-k segmento] [-d d-mer] < muestras > diccionario
+ *
+ * Cada lnea de la entrada (incluido su '\n') es una muestra. Por
+ * defecto se crea un diccionario de 4096 bytes con segmentos de 64
+ * bytes y d-mers de 8 bytes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dictionary.h"
+
+#define DMER_HASH_BITS 20
+#define DMER_HASH_SIZE (1 << DMER_HASH_BITS)
+
+unsigned char *data;
+int data_size;
+int dmer_size = 8;
+
+/* "valid[i]" indica si el d-mer que comienza en "i" est completo
+   dentro de su muestra. */
+unsigned char *valid;
+
+/* Nmero de muestras en las que aparece cada d-mer (por su hash). */
+int *frequency;
+
+/* Apariciones de cada d-mer en el segmento de la bsqueda actual. */
+int *active;
+
+static void *allocate(size_t size) {
+  void *p = calloc(size, 1);
+  if ( !p ) {
+    fprintf(stderr, "dict_train: memoria insuficiente\n");
+    exit(1);
+  }
+  return p;
+}
+
+static unsigned int dmer_hash(int i) {
+  unsigned long long h = 0;
+  int j;
+  for ( j = 0 ; j < dmer_size ; j++ )
+    h = h * 0x100000001B3ULL + data[ i + j ];
+  return (unsigned int) ( ( h * 0x9E3779B97F4A7C15ULL ) >>
+			  ( 64 - DMER_HASH_BITS ) );
+}
+
+/*
+ * Lee las muestras y cuenta, para cada d-mer, en cuntas aparece.
+ * Devuelve el nmero de muestras.
+ */
+static int read_samples() {
+  unsigned int *last_sample;
+  unsigned int h;
+  int capacity = 1 << 20;
+  int samples = 0;
+  int start;
+  int i;
+  int c;
+
+  data = (unsigned char *) allocate(capacity);
+  data_size = 0;
+  while ( ( c = getchar() ) != EOF ) {
+    if ( data_size == capacity ) {
+      capacity *= 2;
+      data = (unsigned char *) realloc(data, capacity);
+      if ( !data ) {
+	fprintf(stderr, "dict_train: memoria insuficiente\n");
+	exit(1);
+      }
+    }
+    data[ data_size++ ] = (unsigned char) c;
+  }
+
+  valid = (unsigned char *) allocate(data_size + 1);
+  frequency = (int *) allocate(DMER_HASH_SIZE * sizeof(int));
+  active = (int *) allocate(DMER_HASH_SIZE * sizeof(int));
+  last_sample = (unsigned int *) allocate(DMER_HASH_SIZE * sizeof(int));
+  for ( start = 0 ; start < data_size ; start = i ) {
+    for ( i = start ; i < data_size && data[ i++ ] != '\n' ; )
+      ;
+    samples++;
+    for ( c = start ; c + dmer_size <= i ; c++ ) {
+      valid[ c ] = 1;
+      h = dmer_hash(c);
+      if ( last_sample[ h ] != (unsigned int) samples ) {
+	last_sample[ h ] = samples;
+	frequency[ h ]++;
+      }
+    }
+  }
+  free(last_sample);
+  return samples;
+}
+
+/*
+ * Busca en [begin, end) el segmento de "k" bytes con mayor
+ * puntuacin y devuelve su comienzo (o -1 si ninguno punta).
+ */
+static int best_segment(int begin, int end, int k) {
+  long long score = 0;
+  long long best_score = 0;
+  int best = -1;
+  int i;
+  unsigned int h;
+
+  /* El segmento que termina en el d-mer "i" comienza en "i - k + d". */
+  for ( i = begin ; i + dmer_size <= end ; i++ ) {
+    if ( valid[ i ] && active[ h = dmer_hash(i) ]++ == 0 )
+      score += frequency[ h ];
+    if ( i - k + dmer_size - 1 >= begin && valid[ i - k + dmer_size - 1 ] &&
+	 --active[ h = dmer_hash(i - k + dmer_size - 1) ] == 0 )
+      score -= frequency[ h ];
+    if ( i - k + dmer_size >= begin && score > best_score ) {
+      best_score = score;
+      best = i - k + dmer_size;
+    }
+  }
+  /* Se vaca "active" para la siguiente bsqueda. */
+  for ( i = end - k > begin ? end - k : begin ; i + dmer_size <= end ; i++ )
+    if ( valid[ i ] )
+      active[ dmer_hash(i) ] = 0;
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned char *dictionary;
+  int dictionary_size = 4096;
+  int k = 64;
+  int samples;
+  int epochs;
+  int epoch_size;
+  int position;
+  int segment;
+  int found;
+  int e;
+  int i;
+
+  for ( i = 1 ; i < argc ; i++ ) {
+    if ( strcmp(argv[ i ], "-s") == 0 && i + 1 < argc )
+      dictionary_size = atoi(argv[ ++i ]);
+    else if ( strcmp(argv[ i ], "-k") == 0 && i + 1 < argc )
+      k = atoi(argv[ ++i ]);
+    else if ( strcmp(argv[ i ], "-d") == 0 && i + 1 < argc )
+      dmer_size = atoi(argv[ ++i ]);
+  }
+  if ( dictionary_size < 1 || dmer_size < 1 || k < dmer_size ) {
+    fprintf(stderr, "dict_train: parmetros incorrectos\n");
+    exit(1);
+  }
+
+  samples = read_samples();
+  dictionary = (unsigned char *) allocate(dictionary_size);
+  position = dictionary_size;
+  epochs = dictionary_size / k;
+  if ( epochs > data_size / k )
+    epochs = data_size / k;
+  if ( epochs < 1 )
+    epochs = 1;
+  epoch_size = data_size / epochs;
+
+  /* Se recorren las pocas, tomando un segmento de cada una, hasta
+     llenar el diccionario o hasta que ninguna poca punte. */
+  do {
+    found = 0;
+    for ( e = 0 ; e < epochs && position > 0 ; e++ ) {
+      segment = best_segment(e*epoch_size,
+			     e < epochs - 1 ? (e + 1)*epoch_size : data_size,
+			     k);
+      if ( segment < 0 )
+	continue;
+      found = 1;
+      for ( i = segment ; i + dmer_size <= segment + k ; i++ )
+	if ( valid[ i ] )
+	  frequency[ dmer_hash(i) ] = 0;
+      i = k < position ? k : position;
+      position -= i;
+      memcpy(dictionary + position, data + segment + k - i, i);
+    }
+  } while ( found && position > 0 );
+
+  write_dictionary(stdout, dictionary + position, dictionary_size - position);
+  fprintf(stderr, "dict_train: %d muestras (%d bytes), diccionario de %d bytes\n",
+	  samples, data_size, dictionary_size - position);
+  return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * dictionary.c
+ *
+ * Diccionarios predefinidos para comprimir datos pequeos (por
+ * ejemplo, registros sueltos). Un diccionario es una secuencia de
+ * bytes tpica de los datos, que el compresor y el descompresor
+ * procesan antes que los propios datos: lzss la coloca en la ventana
+ * y lzw15v construye con ella las primeras cadenas de su diccionario.
+ * Las cadenas ms tiles deben estar al final, que es la parte que
+ * queda ms cerca de los datos.
+ *
+ * El fichero contiene la marca "DICT", el nmero de bytes del
+ * diccionario (4 bytes, little-endian) y los bytes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dictionary.h"
+
+#define MAGIC "DICT"
+#define MAGIC_SIZE 4
+
+/*
+ * Lee el diccionario del fichero "name" y devuelve sus bytes y, en
+ * "size", su nmero.
+ */
+unsigned char *read_dictionary(const char *name, int *size) {
+  unsigned char header[MAGIC_SIZE + 4];
+  unsigned char *data;
+  FILE *file;
+
+  file = fopen(name, "rb");
+  if ( !file ) {
+    fprintf(stderr, "dictionary: no se puede abrir \"%s\"\n", name);
+    exit(1);
+  }
+  if ( fread(header, 1, sizeof(header), file) != sizeof(header) ||
+       memcmp(header, MAGIC, MAGIC_SIZE) != 0 ) {
+    fprintf(stderr, "dictionary: \"%s\" no es un diccionario\n", name);
+    exit(1);
+  }
+  *size = header[ 4 ] | header[ 5 ] << 8 | header[ 6 ] << 16 |
+    header[ 7 ] << 24;
+  if ( *size < 0 ) {
+    fprintf(stderr, "dictionary: \"%s\" no es un diccionario\n", name);
+    exit(1);
+  }
+  data = (unsigned char *) malloc(*size + 1);
+  if ( !data ) {
+    fprintf(stderr, "dictionary: memoria insuficiente\n");
+    exit(1);
+  }
+  if ( fread(data, 1, *size, file) != (size_t) *size ) {
+    fprintf(stderr, "dictionary: \"%s\" est truncado\n", name);
+    exit(1);
+  }
+  fclose(file);
+  return data;
+}
+
+void write_dictionary(FILE *file, const unsigned char *data, int size) {
+  fwrite(MAGIC, 1, MAGIC_SIZE, file);
+  putc(size & 0xFF, file);
+  putc(( size >> 8 ) & 0xFF, file);
+  putc(( size >> 16 ) & 0xFF, file);
+  putc(( size >> 24 ) & 0xFF, file);
+  fwrite(data, 1, size, file);
+}
+
+/*
+ * Devuelve un resumen de 32 bits (FNV-1a) del tamao y los bytes del
+ * diccionario. Los compresores lo escriben en la cabecera para que el
+ * descompresor compruebe que usa el mismo diccionario.
+ */
+unsigned int dictionary_checksum(const unsigned char *data, int size) {
+  unsigned int hash = 2166136261u;
+  int i;
+
+  for ( i = 0 ; i < 4 ; i++ )
+    hash = ( hash ^ ( ( size >> ( 8 * i ) ) & 0xFF ) ) * 16777619u;
+  for ( i = 0 ; i < size ; i++ )
+    hash = ( hash ^ data[ i ] ) * 16777619u;
+  return hash;
+}
@@ -0,0 +1,12 @@
+/*
+ * dictionary.h
+ *
+ * Diccionarios predefinidos: lectura y escritura de los ficheros
+ * creados por dict_train.
+ */
+
+#include <stdio.h>
+
+unsigned char *read_dictionary(const char *name, int *size);
+void write_dictionary(FILE *file, const unsigned char *data, int size);
+unsigned int dictionary_checksum(const unsigned char *data, int size);
@@ -99,3 +99,14 @@ void finish_encoder() {
 /* Finaliza el descodificador. */
 void finish_decoder() {
 }
+
+/* Punto de sincronizacin: como cada cdigo termina en un bit
+   conocido, basta con alinear la salida al siguiente byte. */
+void sync_encoder() {
+  sync_output();
+}
+
+/* Salta el relleno del punto de sincronizacin. */
+void sync_decoder() {
+  align_input();
+}
@@ -0,0 +1,97 @@
+/*
+ * golomb_ctx.c
+ *
+ * Parmetro de Golomb-Rice adaptativo por contexto.
+ *
+ * En lugar de estimar un nico parmetro a partir de un modelo
+ * probabilstico global (como hacen golomb.c y rice.c con
+ * model_a0.c), cada contexto guarda la suma "A" de las magnitudes que
+ * ha codificado y su nmero "N". El parmetro ptimo de un cdigo de
+ * Rice es aproximadamente log2(A/N), es decir, el menor "k" que cumple
+ * N*2^k >= A. Cuando "N" alcanza un umbral, "A" y "N" se dividen entre
+ * dos, de forma que el modelo olvida el pasado lejano.
+ *
+ * Referencias:
+ *
+ * M. J. Weinberger, G. Seroussi and G. Sapiro, "The LOCO-I Lossless
+ * Image Compression Algorithm: Principles and Standardization into
+ * JPEG-LS," IEEE Trans. Image Processing, vol. 9, no. 8,
+ * pp. 1309--1324, Aug. 2000.
+ */
+
+#include <stdio.h>
+#include "bitio.h"
+#include "golomb_ctx.h"
+
+/* Inicializa un contexto. */
+void init_golomb_context(GOLOMB_CONTEXT *ctx, unsigned int initial_A) {
+  ctx->A = initial_A;
+  ctx->N = 1;
+}
+
+/* Posicin del bit ms significativo de "x" (x > 0). */
+static int msb(unsigned int x) {
+  return 31 - __builtin_clz(x);
+}
+
+/* Calcula el menor "k" tal que N*2^k >= A. La diferencia entre las
+   posiciones de los bits ms significativos de "A" y "N" acierta o se
+   queda corta en una unidad, lo que evita el bucle sobre "k". */
+int golomb_parameter(unsigned int N, unsigned int A) {
+  int k;
+  if(A <= N) return 0;
+  k = msb(A) - msb(N);
+  if((N << k) < A) k++;
+  return k;
+}
+
+/* Acumula "magnitude" en el contexto, dividiendo los recuentos entre
+   dos cuando "N" alcanza "reset". */
+void update_golomb_context(GOLOMB_CONTEXT *ctx, unsigned int magnitude,
+			   unsigned int reset) {
+  ctx->A += magnitude;
+  if(ctx->N == reset) {
+    ctx->A >>= 1;
+    ctx->N >>= 1;
+  }
+  ctx->N++;
+}
+
+/* Emite "q" unos seguidos de un cero. */
+static void put_unary(int q) {
+  while(q > 24) {
+    put_bits(0xFFFFFF, 24);
+    q -= 24;
+  }
+  put_bits(((1<<q)-1)<<1, q+1);
+}
+
+static int get_unary() {
+  int q = 0;
+  while(get_bit()) q++;
+  return q;
+}
+
+/* Cdigo de Golomb-Rice de orden "k" limitado a "limit" bits. Si el
+   cociente es demasiado grande se enva un prefijo de escape seguido
+   de "m-1" en binario natural usando "qbits" bits (m > 0 siempre que
+   se escapa). */
+void put_golomb(unsigned int m, int k, int limit, int qbits) {
+  unsigned int q = m >> k;
+  if(q < (unsigned int)(limit - qbits - 1)) {
+    put_unary(q);
+    if(k) put_bits(m, k);
+  } else {
+    put_unary(limit - qbits - 1);
+    put_bits(m - 1, qbits);
+  }
+}
+
+unsigned int get_golomb(int k, int limit, int qbits) {
+  unsigned int q = get_unary();
+  if(q < (unsigned int)(limit - qbits - 1)) {
+    if(k) return (q<<k) | get_bits(k);
+    return q;
+  }
+  return get_bits(qbits) + 1;
+}
@@ -0,0 +1,19 @@
+/*
+ * golomb_ctx.h
+ *
+ * Estimacin adaptativa, por contexto, del parmetro de un cdigo de
+ * Golomb-Rice.
+ */
+
+/* Estadsticas de un contexto. */
+typedef struct {
+  unsigned int A; /* Suma de las magnitudes codificadas. */
+  unsigned int N; /* Nmero de valores codificados. */
+} GOLOMB_CONTEXT;
+
+void init_golomb_context(GOLOMB_CONTEXT *ctx, unsigned int initial_A);
+int  golomb_parameter(unsigned int N, unsigned int A);
+void update_golomb_context(GOLOMB_CONTEXT *ctx, unsigned int magnitude,
+			   unsigned int reset);
+void put_golomb(unsigned int m, int k, int limit, int qbits);
+unsigned int get_golomb(int k, int limit, int qbits);
@@ -0,0 +1,59 @@
+/*
+ * histogram.c
+ *
+ * Recuento de la frecuencia de cada byte de un buffer, para los
+ * codecs que recorren sus datos dos veces (p. ej. huff.c).
+ *
+ * El recuento directo, un "counts[c]++" por byte, es lento cuando los
+ * bytes se repiten: cada incremento tiene que esperar a que se
+ * almacene el anterior sobre el mismo contador. Aqu se usan 4
+ * sub-histogramas, de forma que bytes consecutivos incrementan
+ * contadores distintos, que se suman al final. La entrada se lee en
+ * palabras de 8 bytes (16 bytes por iteracin) y los bytes se extraen
+ * con desplazamientos.
+ */
+
+#include <string.h>
+#include "histogram.h"
+
+static unsigned long long load_64(const unsigned char *p) {
+  unsigned long long x;
+  memcpy(&x, p, 8);
+  return x;
+}
+
+/* Cuenta los 8 bytes de "w" (en el orden de la mquina, que no
+   importa para el recuento) en los 4 sub-histogramas. */
+#define COUNT_WORD(w) do {				\
+    c0[ (w)         & 0xFF]++;				\
+    c1[ ((w) >>  8) & 0xFF]++;				\
+    c2[ ((w) >> 16) & 0xFF]++;				\
+    c3[ ((w) >> 24) & 0xFF]++;				\
+    c0[ ((w) >> 32) & 0xFF]++;				\
+    c1[ ((w) >> 40) & 0xFF]++;				\
+    c2[ ((w) >> 48) & 0xFF]++;				\
+    c3[  (w) >> 56        ]++;				\
+  } while ( 0 )
+
+/* Calcula en "counts" (256 contadores) el histograma de "data". */
+void histogram(const unsigned char *data, size_t size, unsigned int *counts) {
+  unsigned int c0[256], c1[256], c2[256], c3[256];
+  unsigned long long w0, w1;
+  size_t i;
+  int s;
+
+  memset(c0, 0, sizeof(c0));
+  memset(c1, 0, sizeof(c1));
+  memset(c2, 0, sizeof(c2));
+  memset(c3, 0, sizeof(c3));
+  for ( i = 0 ; i + 16 <= size ; i += 16 ) {
+    w0 = load_64(data + i);
+    w1 = load_64(data + i + 8);
+    COUNT_WORD(w0);
+    COUNT_WORD(w1);
+  }
+  for ( ; i < size ; i++ )
+    c0[ data[ i ] ]++;
+  for ( s = 0 ; s < 256 ; s++ )
+    counts[ s ] = c0[ s ] + c1[ s ] + c2[ s ] + c3[ s ];
+}
@@ -0,0 +1,9 @@
+/*
+ * histogram.h
+ *
+ * Recuento de la frecuencia de cada byte de un buffer.
+ */
+
+#include <stddef.h>
+
+void histogram(const unsigned char *data, size_t size, unsigned int *counts);
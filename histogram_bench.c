@@ -0,0 +1,95 @@
+/*
+ * histogram_bench.c
+ *
+ * Mide la velocidad de histogram.c frente al recuento directo, sobre
+ * datos de baja entropa y sobre datos aleatorios.
+ *
+ * Uso:
+ *
+ * histogram_bench [megabytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "histogram.h"
+
+#define REPETITIONS 10
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* El recuento de referencia: un incremento por byte. */
+static void direct(const unsigned char *data, size_t size,
+		   unsigned int *counts) {
+  size_t i;
+  memset(counts, 0, 256 * sizeof(unsigned int));
+  for ( i = 0 ; i < size ; i++ )
+    counts[ data[ i ] ]++;
+}
+
+static void run(const char *name, const unsigned char *data, size_t size) {
+  static struct {
+    const char *name;
+    void (*count)(const unsigned char *, size_t, unsigned int *);
+  } methods[] = {
+    { "directo", direct },
+    { "4 tablas", histogram }
+  };
+  unsigned int reference[256], counts[256];
+  double t, best;
+  int m, r;
+
+  direct(data, size, reference);
+  for ( m = 0 ; m < 2 ; m++ ) {
+    best = 1e30;
+    for ( r = 0 ; r < REPETITIONS ; r++ ) {
+      t = now();
+      methods[ m ].count(data, size, counts);
+      t = now() - t;
+      if ( t < best )
+	best = t;
+    }
+    if ( memcmp(counts, reference, sizeof(counts)) ) {
+      fprintf(stderr, "histogram_bench: recuento errneo (%s)\n",
+	      methods[ m ].name);
+      exit(1);
+    }
+    printf("%-12s %-10s %10.1f MB/s\n", name, methods[ m ].name,
+	   size / best / 1e6);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t size = 64, i;
+  unsigned char *data;
+
+  if ( argc > 1 )
+    size = atoi(argv[ 1 ]);
+  size <<= 20;
+  data = malloc(size);
+  if ( !data ) {
+    fprintf(stderr, "histogram_bench: memoria insuficiente\n");
+    exit(1);
+  }
+
+  memset(data, 0, size);
+  run("ceros", data, size);
+
+  /* Rachas cortas de unos pocos smbolos. */
+  srand(1);
+  for ( i = 0 ; i < size ; i++ )
+    data[ i ] = ( rand() & 7 ) ? ( i ? data[ i - 1 ] : 'a' ) : 'a' + rand() % 4;
+  run("rachas", data, size);
+
+  for ( i = 0 ; i < size ; i++ )
+    data[ i ] = rand();
+  run("aleatorios", data, size);
+
+  free(data);
+  return 0;
+}
@@ -9,45 +9,76 @@
  * D. A. Huffman, Proceedings of the Institute of Radio Engineers,
  * Vol. 40, pp. 1098-1101. 1952.
  * M. Nelson and J.-L. Gailly, The Data Compression Book. 1995.
+ * L. L. Larmore and D. S. Hirschberg, "A Fast Algorithm for Optimal
+ * Length-Limited Huffman Codes," J. ACM, 37(3):464-473. 1990.
+ *
+ * Uso:
+ *
+ * huff_s0 e [-c [-l longitud_mxima]] < fichero > comprimido
+ * huff_s0 d [-c] < comprimido > fichero
+ *
+ * La opcin "-c" selecciona el modo cannico (que debe indicarse
+ * tambin al descomprimir): las longitudes de los cdigos se limitan
+ * a "longitud_mxima" bits (11 por defecto, entre 11 y 15) y slo se
+ * transmiten dichas longitudes. El descodificador es dirigido por
+ * tablas y puede resolver varios smbolos en cada consulta. Sin "-c",
+ * los cdigos (que incluyen el smbolo END_OF_STREAM) se limitan a
+ * MAX_MAX_CODE_LENGTH bits y se descodifican recorriendo el rbol bit
+ * a bit.
+ *
+ * En ambos modos las longitudes de los cdigos se calculan a partir
+ * de los recuentos exactos de cada bloque y se transmiten codificadas
+ * por longitud de rachas, como en Deflate (RFC 1951).
+ *
+ * La entrada se comprime en bloques de BLOCK_SIZE bytes, cada uno
+ * con su propio modelo, por lo que la memoria usada no depende del
+ * tamao del fichero. Cada bloque empieza en un byte nuevo del
+ * code-stream y ste termina con el ltimo bloque.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-//#include "bitio.h"
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "bitio.h"
+#include "histogram.h"
+#include "canonical.h"
 //#include "main.h"
 
 /*
- * The NODE structure is a node in the Huffman decoding tree.  It has a
- * count, which is its weight in the tree, and the node numbers of its
- * two children.
+ * The NODE structure is a node in the Huffman decoding tree. It has
+ * the node numbers of its two children.
  */
 typedef struct tree_node {
-  unsigned int count;
   int child_0;
   int child_1;
 } NODE;
 
 /*
  * A Huffman tree is set up for decoding, not encoding. When encoding,
- * I first walk through the tree and build up a table of codes for
- * each symbol. The codes are stored in this CODE structure.
+ * the codes are assigned from the code lengths and stored in a CODE
+ * structure (see canonical.h).
  */
-typedef struct code {
-  unsigned int code;
-  int code_bits;
-} CODE;
 
 /*
- * Mantiene una copia de la entrada estndar. Recurdese que este
- * programa funciona en dos pasadas. En la primera se calcula el
- * recuento de cada byte en el fichero a comprimir. En la segunda se
- * comprime. "tmp_file" almacena una copia de la entrada estndar en
- * un fichero temporal para poder recorrer el stream de entrada dos
- * veces.
+ * Recurdese que este programa funciona en dos pasadas. En la
+ * primera se calcula el recuento de cada byte del bloque a comprimir
+ * y en la segunda se comprime. Para poder recorrer el bloque dos
+ * veces, ste se mantiene en memoria: si la entrada estndar es un
+ * fichero regular se proyecta en memoria con mmap() (sin copiarlo) y
+ * en otro caso se lee en "block_buffer".
  */
-FILE *tmp_file;
+#define BLOCK_SIZE (1 << 20)
+
+static unsigned char *block_buffer;
+static unsigned char *mapped_block;
+static size_t mapped_size;
+static off_t input_size, input_offset;
+static int input_mapped = -1;
 
 /*
  * The special EOS symbol is 256, the first available symbol after all
@@ -55,106 +86,143 @@ FILE *tmp_file;
  * indicates that all of the data has been read in.
  */
 #define END_OF_STREAM 256
+#define MAX_SYMBOLS (END_OF_STREAM + 1)
 
 /*
- * Comprime el stream de entrada.
+ * Longitud mxima, por defecto y permitida, de los cdigos del modo
+ * cannico. Con 11 bits la tabla de descodificacin ocupa 8 KB.
  */
-void encode_stream() {
-  unsigned long counts[256];
-  NODE nodes[514];
-  CODE codes[257];
-  int root_node;
-  count_bytes(counts);
-  scale_counts( counts, nodes );
-  output_counts(nodes);
-  root_node = build_tree( nodes );
-  convert_tree_to_code( nodes, codes, 0, 0, root_node );
-  compress_data(codes);
-}
+#define DEFAULT_MAX_CODE_LENGTH 11
+#define MIN_MAX_CODE_LENGTH 11
+#define MAX_MAX_CODE_LENGTH CANONICAL_MAX_LENGTH
 
 /*
- * Expande el stream de entrada.
+ * Tamao de los buffers de entrada y salida del descodificador
+ * cannico.
  */
-void decode_stream() {
-  NODE nodes[514];
-  int root_node;
-  input_counts(nodes);
-  root_node = build_tree( nodes );
-  expand_data(nodes, root_node);
-}
+#define IO_BUFFER_SIZE 65536
+
+unsigned char *next_block(size_t *size);
+void encode_block_canonical(unsigned char *block, size_t size, int max_length);
+void decode_stream_canonical();
 
 /*
- * This routine counts the frequency of occurence of every byte in
- * the input file.
+ * Comprime el stream de entrada.
  */
-count_bytes(unsigned long *counts) {
-  int c;
-  char tmp_filename[80], number[5];
-  sprintf(number,"%d", getpid()%1000);
-  strcpy(tmp_filename, "/tmp/");
-  strcat(tmp_filename, number);
-  tmp_file = fopen(tmp_filename, "w+");
-  if(!tmp_file) {
-    fprintf(stderr, "huff: imposible abrir (%s)\n", tmp_filename);
+void encode_stream(int argc, char *argv[]) {
+  unsigned long counts[MAX_SYMBOLS];
+  int lengths[MAX_SYMBOLS];
+  CODE codes[MAX_SYMBOLS];
+  int i;
+  unsigned char *block;
+  size_t size;
+  int canonical = 0;
+  int max_length = DEFAULT_MAX_CODE_LENGTH;
+  for ( i = 2 ; i < argc ; i++ ) {
+    if ( strcmp( argv[ i ], "-c" ) == 0 )
+      canonical = 1;
+    else if ( strcmp( argv[ i ], "-l" ) == 0 && i + 1 < argc )
+      max_length = atoi( argv[ ++i ] );
+  }
+  if ( max_length < MIN_MAX_CODE_LENGTH || max_length > MAX_MAX_CODE_LENGTH ) {
+    fprintf(stderr, "huff: la longitud mxima debe estar entre %d y %d\n",
+	    MIN_MAX_CODE_LENGTH, MAX_MAX_CODE_LENGTH);
     exit(1);
   }
-  while ( (c = getchar()) != EOF ) {
-    counts[ c ]++;
-    putc(c, tmp_file);
+  while ( ( block = next_block(&size) ) != NULL ) {
+    if ( canonical ) {
+      encode_block_canonical(block, size, max_length);
+      continue;
+    }
+    count_bytes(block, size, counts);
+    counts[ END_OF_STREAM ] = 1;
+    compute_lengths(counts, MAX_SYMBOLS, lengths, MAX_MAX_CODE_LENGTH);
+    assign_canonical_codes(lengths, MAX_SYMBOLS, codes);
+    output_lengths(lengths, MAX_SYMBOLS, put_bits);
+    compress_data(block, size, codes);
   }
-  fflush(tmp_file);
-  rewind(tmp_file);
 }
 
 /*
- * In order to limit the size of my Huffman codes to 16 bits, I scale
- * my counts down so they fit in an unsigned char, and then store them
- * all as initial weights in my NODE array.  The only thing to be
- * careful of is to make sure that a node with a non-zero count doesn't
- * get scaled down to 0. Nodes with values of 0 don't get codes.
+ * Expande el stream de entrada.
  */
-scale_counts(unsigned long *counts, NODE *nodes) {
-  unsigned long max_count;
-  int i;
-  max_count = 0;
-  for ( i = 0 ; i < 256 ; i++ )
-    if ( counts[ i ] > max_count )
-      max_count = counts[ i ];
-  if ( max_count == 0 ) {
-    counts[ 0 ] = 1;
-    max_count = 1;
+void decode_stream(int argc, char *argv[]) {
+  NODE nodes[2*MAX_SYMBOLS];
+  int lengths[MAX_SYMBOLS];
+  int root_node;
+  int i, c;
+  for ( i = 2 ; i < argc ; i++ ) {
+    if ( strcmp( argv[ i ], "-c" ) == 0 ) {
+      decode_stream_canonical();
+      return;
+    }
   }
-  max_count = max_count / 255;
-  max_count = max_count + 1;
-  for ( i = 0 ; i < 256 ; i++ ) {
-    nodes[ i ].count = (unsigned int) ( counts[ i ] / max_count );
-    if ( nodes[ i ].count == 0 && counts[ i ] != 0 )
-      nodes[ i ].count = 1;
+  while ( ( c = getchar() ) != EOF ) {
+    ungetc(c, stdin);
+    input_lengths(lengths, MAX_SYMBOLS, get_bits);
+    root_node = build_tree( lengths, nodes );
+    expand_data(nodes, root_node);
+    align_input();
   }
-  nodes[ END_OF_STREAM ].count = 1;
 }
 
 /*
- * Since the Huffman tree is built as a decoding tree, there is
- * no simple way to get the encoding values for each symbol out of
- * it. This routine recursively walks through the tree, adding the
- * child bits to each code until it gets to a leaf.  When it gets
- * to a leaf, it stores the code value in the CODE element, and
- * returns.
+ * Devuelve el siguiente bloque de la entrada estndar y su tamao, o
+ * NULL cuando sta se ha agotado. La proyeccin del bloque anterior
+ * se deshace antes de proyectar el siguiente.
  */
-convert_tree_to_code(NODE *nodes, CODE *codes,
-			  unsigned int code_so_far, int bits, int node) {
-  if ( node <= END_OF_STREAM ) {
-    codes[ node ].code = code_so_far;
-    codes[ node ].code_bits = bits;
-    return;
+unsigned char *next_block(size_t *size) {
+  struct stat st;
+  size_t n;
+  if ( input_mapped < 0 ) {
+    input_mapped = fstat(fileno(stdin), &st) == 0 && S_ISREG(st.st_mode) &&
+      lseek(fileno(stdin), 0, SEEK_CUR) == 0;
+    input_size = input_mapped ? st.st_size : 0;
+    input_offset = 0;
   }
-  code_so_far <<= 1;
-  bits++;
-  convert_tree_to_code( nodes, codes, code_so_far, bits,
-			nodes[ node ].child_0 );
-  convert_tree_to_code( nodes, codes, code_so_far | 1,
-			bits, nodes[ node ].child_1 );
+  if ( input_mapped ) {
+    if ( mapped_block )
+      munmap(mapped_block, mapped_size);
+    mapped_block = NULL;
+    if ( input_offset >= input_size )
+      return NULL;
+    mapped_size = input_size - input_offset;
+    if ( mapped_size > BLOCK_SIZE )
+      mapped_size = BLOCK_SIZE;
+    mapped_block = mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE,
+			fileno(stdin), input_offset);
+    if ( mapped_block == MAP_FAILED ) {
+      perror("huff: mmap");
+      exit(1);
+    }
+    input_offset += mapped_size;
+    *size = mapped_size;
+    return mapped_block;
+  }
+  if ( !block_buffer ) {
+    block_buffer = malloc(BLOCK_SIZE);
+    if ( !block_buffer ) {
+      fprintf(stderr, "huff: memoria insuficiente\n");
+      exit(1);
+    }
+  }
+  n = fread(block_buffer, 1, BLOCK_SIZE, stdin);
+  if ( n == 0 )
+    return NULL;
+  *size = n;
+  return block_buffer;
+}
+
+/*
+ * This routine counts the frequency of occurence of every byte in
+ * the block.
+ */
+count_bytes(unsigned char *block, size_t size, unsigned long *counts) {
+  unsigned int block_counts[256];
+  int i;
+  histogram(block, size, block_counts);
+  for ( i = 0 ; i < 256 ; i++ )
+    counts[ i ] = block_counts[ i ];
 }
 
 
@@ -163,117 +231,49 @@ convert_tree_to_code(NODE *nodes, CODE *codes,
  * the data is a breeze.  Each byte is read in, and its corresponding
  * Huffman code is sent out.
  */
-compress_data(CODE *codes) {
-  int c;
-  while((c=getc(tmp_file))!=EOF) {
-    put_bits(codes[ c ].code, codes[ c ].code_bits );
-  }
+compress_data(unsigned char *block, size_t size, CODE *codes) {
+  size_t i;
+  for ( i = 0 ; i < size ; i++ )
+    put_bits(codes[ block[ i ] ].code, codes[ block[ i ] ].code_bits );
   put_bits(codes[END_OF_STREAM].code, codes[END_OF_STREAM].code_bits );
-  flush();
+  align_output();
 }
 
 /*
- * In order for the compressor to build the same model, I have to store
- * the symbol counts in the compressed file so the expander can read
- * them in.  In order to save space, I don't save all 256 symbols
- * unconditionally.  The format used to store counts looks like this:
- *
- *  start, stop, counts, start, stop, counts, ... 0
- *
- * This means that I store runs of counts, until all the non-zero
- * counts have been stored.  At this time the list is terminated by
- * storing a start value of 0.  Note that at least 1 run of counts has
- * to be stored, so even if the first start value is 0, I read it in.
- * It also means that even in an empty file that has no counts, I have
- * to pass at least one count.
- *
- * In order to efficiently use this format, I have to identify runs of
- * non-zero counts.  Because of the format used, I don't want to stop a
- * run because of just one or two zeros in the count stream.  So I have
- * to sit in a loop looking for strings of three or more zero values in
- * a row.
- *
- * This is simple in concept, but it ends up being one of the most
- * complicated routines in the whole program.  A routine that just
- * writes out 256 values without attempting to optimize would be much
- * simpler, but would hurt compression quite a bit on small files.
- *
+ * The decoding tree is built from the canonical codes: the code of
+ * each symbol is walked from the root, creating the internal nodes
+ * that are missing, and the last child is the leaf. Internal nodes
+ * are numbered after END_OF_STREAM, so expand_data() can tell them
+ * from leaves.
  */
-output_counts(NODE *nodes) {
-  int first;
-  int last;
-  int next;
-  int i;
-  
-  first = 0;
-  while ( first < 255 && nodes[ first ].count == 0 )
-    first++;
-  /*
-   * Each time I hit the start of the loop, I assume that first is the
-   * number for a run of non-zero values.  The rest of the loop is *
-   * concerned with finding the value for last, which is the end of
-   * the * run, and the value of next, which is the start of the next
-   * run.  * At the end of the loop, I assign next to first, so it
-   * starts in on * the next run.
-   */
-  for ( ; first < 256 ; first = next ) {
-    last = first + 1;
-    for ( ; ; ) {
-      for ( ; last < 256 ; last++ )
-	if ( nodes[ last ].count == 0 )
-	  break;
-      last--;
-      for ( next = last + 1; next < 256 ; next++ )
-	if ( nodes[ next ].count != 0 )
-	  break;
-      if ( next > 255 )
-	break;
-      if ( ( next - last ) > 3 )
-	break;
-      last = next;
-    };
-    /*
-     * Here is where I output first, last, and all the counts in
-     * between.
-     */
-    putchar(first);
-    putchar(last);
-    for ( i = first ; i <= last ; i++ ) {
-      putchar(nodes[i].count);
-    }
-  }
-  putchar(0);
-  fflush(stdout);
-}
+int build_tree( int *lengths, NODE *nodes ) {
+  CODE codes[MAX_SYMBOLS];
+  int root_node, next_free, node, s, bit, *child;
 
-
-/*
- * When expanding, I have to read in the same set of counts.  This is
- * quite a bit easier that the process of writing them out, since no
- * decision making needs to be done.  All I do is read in first, check
- * to see if I am all done, and if not, read in last and a string of
- * counts.
- */
-input_counts(NODE *nodes) {
-  int first;
-  int last;
-  int i;
-  int c;
-  
-  for ( i = 0 ; i < 256 ; i++ )
-    nodes[ i ].count = 0;
-  first = getchar();
-  last = getchar();
-  for ( ; ; ) {
-    for ( i = first ; i <= last ; i++ ) {
-      c = getc( stdin );
-      nodes[ i ].count = (unsigned int)c;
+  assign_canonical_codes(lengths, MAX_SYMBOLS, codes);
+  root_node = next_free = END_OF_STREAM + 1;
+  nodes[ root_node ].child_0 = nodes[ root_node ].child_1 = -1;
+  for ( s = 0 ; s < MAX_SYMBOLS ; s++ ) {
+    node = root_node;
+    for ( bit = lengths[ s ] - 1 ; bit >= 0 ; bit-- ) {
+      child = ( codes[ s ].code >> bit ) & 1 ?
+	&nodes[ node ].child_1 : &nodes[ node ].child_0;
+      if ( bit == 0 ) {
+	*child = s;
+	break;
+      }
+      if ( *child < 0 ) {
+	if ( ++next_free >= 2*MAX_SYMBOLS ) {
+	  fprintf(stderr, "huff: longitudes de cdigo incorrectas\n");
+	  exit(1);
+	}
+	nodes[ next_free ].child_0 = nodes[ next_free ].child_1 = -1;
+	*child = next_free;
+      }
+      node = *child;
     }
-    first = getchar();
-    if(first==0) break;
-    last = getchar();
   }
-  nodes[ END_OF_STREAM ].count = 1;
+  return root_node;
 }
 
 /*
@@ -297,6 +297,10 @@ expand_data(NODE *nodes, int root_node) {
       else {
 	node = nodes[ node ].child_0;
       }
+      if ( node < 0 ) {
+	fprintf(stderr, "huff: cdigo incorrecto\n");
+	exit(1);
+      }
     } while ( node > END_OF_STREAM );
     if ( node == END_OF_STREAM )
       break;
@@ -305,48 +309,476 @@ expand_data(NODE *nodes, int root_node) {
 }
 
 /*
- * Building the Huffman tree is fairly simple.  All of the active nodes
- * are scanned in order to locate the two nodes with the minimum
- * weights. These two weights are added together and assigned to a new
- * node. The new node makes the two minimum nodes into its 0 child
- * and 1 child. The two minimum nodes are then marked as inactive.
- * This process repeats until their is only one node left, which is the
- * root node.  The tree is done, and the root node is passed back
- * to the calling routine.
+ * Modo cannico.
+ *
+ * En un cdigo de Huffman cannico los cdigos de cada longitud son
+ * enteros consecutivos, asignados en orden de smbolo, por lo que
+ * basta con conocer la longitud del cdigo de cada smbolo para
+ * reconstruir el cdigo completo. Cada bloque del code-stream tiene
+ * la forma:
+ *
+ *  nmero de smbolos, longitudes, cdigos
+ *
+ * donde el nmero de smbolos se escribe en bytes de 7 bits (el bit
+ * ms significativo indica que hay ms bytes) y las longitudes se
+ * codifican con output_lengths(), completando el ltimo byte. Como se
+ * conoce el nmero de smbolos, no es necesario el smbolo
+ * END_OF_STREAM.
  *
- * Node 513 is used here to arbitratily provide a node with a guaranteed
- * maximum value.  It starts off being min_1 and min_2.  After all active
- * nodes have been scanned, I can tell if there is only one active node
- * left by checking to see if min_1 is still 513.
+ * Los bloques de al menos MULTI_STREAM_MIN_SIZE smbolos se dividen
+ * en 4 segmentos consecutivos (los 3 primeros de (n+3)/4 smbolos)
+ * que se codifican en 4 code-streams independientes, como en Huff0:
+ *
+ *  nmero de smbolos, longitudes, tamaos, code-stream 0, ..., 3
+ *
+ * donde los tamaos en bytes de los 4 code-streams se escriben como
+ * el nmero de smbolos. As el descodificador puede avanzar por los
+ * 4 code-streams en el mismo bucle, con 4 cadenas de dependencias
+ * independientes en lugar de una sola.
+ */
+#define MULTI_STREAM_MIN_SIZE 8192
+#define STREAMS 4
+
+/*
+ * Escribe un entero sin signo en bytes de 7 bits.
  */
-int build_tree( NODE *nodes ) {
-  int next_free;
+void output_varint(unsigned long long x) {
+  while ( x >= 0x80 ) {
+    putchar( (int) ( x & 0x7F ) | 0x80 );
+    x >>= 7;
+  }
+  putchar( (int) x );
+}
+
+static void store_64(unsigned char *p, unsigned long long x) {
   int i;
-  int min_1;
-  int min_2;
-  
-  nodes[ 513 ].count = 0xffff;
-  for ( next_free = END_OF_STREAM + 1 ; ; next_free++ ) {
-    min_1 = 513;
-    min_2 = 513;
-    for ( i = 0 ; i < next_free ; i++ )
-      if ( nodes[ i ].count != 0 ) {
-	if ( nodes[ i ].count < nodes[ min_1 ].count ) {
-	  min_2 = min_1;
-	  min_1 = i;
-	} else if ( nodes[ i ].count < nodes[ min_2 ].count )
-	  min_2 = i;
+  for ( i = 0 ; i < 8 ; i++ )
+    p[ i ] = (unsigned char) ( x >> ( 8*i ) );
+}
+
+/*
+ * Codifica "size" smbolos en un code-stream en memoria, con el mismo
+ * formato que bitio: el primer bit de cada cdigo ocupa el bit libre
+ * menos significativo del byte actual. Por eso los cdigos se guardan
+ * invertidos en "codes" y se acumulan en "bits" desde la posicin
+ * menos significativa. Tras cada 3 cdigos (a lo sumo 45 bits) se
+ * escriben los bytes completos con un nico almacenamiento de 8
+ * bytes, por lo que "out" debe tener 8 bytes libres tras el final del
+ * code-stream. Devuelve el nmero de bytes escritos.
+ */
+size_t encode_symbols(unsigned char *block, size_t size, CODE *codes,
+		      unsigned char *out) {
+  unsigned char *start = out;
+  unsigned long long bits = 0;
+  int count = 0;
+  size_t i = 0;
+  for ( ; i + 3 <= size ; i += 3 ) {
+    bits |= (unsigned long long) codes[ block[ i ] ].code << count;
+    count += codes[ block[ i ] ].code_bits;
+    bits |= (unsigned long long) codes[ block[ i + 1 ] ].code << count;
+    count += codes[ block[ i + 1 ] ].code_bits;
+    bits |= (unsigned long long) codes[ block[ i + 2 ] ].code << count;
+    count += codes[ block[ i + 2 ] ].code_bits;
+    store_64(out, bits);
+    out += count >> 3;
+    bits >>= count & ~7;
+    count &= 7;
+  }
+  for ( ; i < size ; i++ ) {
+    bits |= (unsigned long long) codes[ block[ i ] ].code << count;
+    count += codes[ block[ i ] ].code_bits;
+  }
+  store_64(out, bits);
+  return ( out - start ) + ( count + 7 ) / 8;
+}
+
+/*
+ * Escritura de las longitudes en modo cannico: los bits se acumulan
+ * en "header" en el mismo orden que los cdigos.
+ */
+static unsigned char header[MAX_SYMBOLS * 2];
+static unsigned char *header_out;
+static unsigned int header_bits;
+static int header_count;
+
+static void put_header_bits(int bits, int number_of_bits) {
+  header_bits |= (unsigned int) bits << header_count;
+  header_count += number_of_bits;
+  while ( header_count >= 8 ) {
+    *header_out++ = header_bits;
+    header_bits >>= 8;
+    header_count -= 8;
+  }
+}
+
+/*
+ * Compresin de un bloque en modo cannico.
+ */
+void encode_block_canonical(unsigned char *block, size_t size,
+			    int max_length) {
+  static unsigned char *output;
+  static size_t output_size;
+  unsigned long counts[256];
+  int lengths[256];
+  CODE codes[256];
+  size_t i, segment, stream_size[STREAMS], total;
+
+  count_bytes(block, size, counts);
+  output_varint(size);
+  compute_lengths(counts, 256, lengths, max_length);
+  assign_canonical_codes(lengths, 256, codes);
+  header_out = header;
+  header_bits = header_count = 0;
+  output_lengths(lengths, 256, put_header_bits);
+  if ( header_count > 0 )
+    *header_out++ = header_bits;
+  fwrite(header, 1, header_out - header, stdout);
+  for ( i = 0 ; i < 256 ; i++ )
+    codes[ i ].code = reverse_bits(codes[ i ].code, codes[ i ].code_bits);
+  /* Ningn cdigo supera los 16 bits. */
+  if ( output_size < 2*size + 8 ) {
+    free(output);
+    output_size = 2*size + 8;
+    output = malloc(output_size);
+    if ( !output ) {
+      fprintf(stderr, "huff: memoria insuficiente\n");
+      exit(1);
+    }
+  }
+  if ( size < MULTI_STREAM_MIN_SIZE ) {
+    total = encode_symbols(block, size, codes, output);
+  } else {
+    segment = ( size + STREAMS - 1 ) / STREAMS;
+    total = 0;
+    for ( i = 0 ; i < STREAMS ; i++ ) {
+      stream_size[ i ] =
+	encode_symbols(block + i*segment,
+		       i < STREAMS - 1 ? segment : size - i*segment,
+		       codes, output + total);
+      total += stream_size[ i ];
+    }
+    for ( i = 0 ; i < STREAMS ; i++ )
+      output_varint(stream_size[ i ]);
+  }
+  fwrite(output, 1, total, stdout);
+}
+
+/*
+ * Lectura de bits para el descodificador cannico. El code-stream se
+ * lee en bloques de IO_BUFFER_SIZE bytes. Tras el final del
+ * code-stream se leen ceros. Si "in" ha sobrepasado "input_end" es
+ * que se ha alcanzado ya el final del code-stream (fread() slo lee
+ * menos bytes de los pedidos en ese caso), y se mantiene "in" para no
+ * perder la posicin en el code-stream.
+ */
+static unsigned char input_buffer[IO_BUFFER_SIZE + 16];
+static unsigned char *input_end = input_buffer;
+
+static unsigned char *reload_input(unsigned char *in) {
+  size_t n;
+  if ( in > input_end ) {
+    if ( in > input_end + 8 ) {
+      fprintf(stderr, "huff: code-stream truncado\n");
+      exit(1);
+    }
+    return in;
+  }
+  n = input_end - in;
+  memmove(input_buffer, in, n);
+  n += fread(input_buffer + n, 1, IO_BUFFER_SIZE - n, stdin);
+  input_end = input_buffer + n;
+  memset(input_end, 0, 16);
+  return input_buffer;
+}
+
+/*
+ * Lee el siguiente byte del buffer de entrada, o EOF si el
+ * code-stream se ha agotado.
+ */
+static int next_input_byte(unsigned char **in) {
+  if ( *in >= input_end ) {
+    *in = reload_input(*in);
+    if ( *in >= input_end )
+      return EOF;
+  }
+  return *(*in)++;
+}
+
+/*
+ * Lee un entero escrito por output_varint() cuyo primer byte es "c".
+ */
+unsigned long long input_varint(int c, unsigned char **in) {
+  unsigned long long x = 0;
+  int shift = 0;
+  for ( ; ; ) {
+    if ( c == EOF ) {
+      fprintf(stderr, "huff: code-stream truncado\n");
+      exit(1);
+    }
+    x |= (unsigned long long) ( c & 0x7F ) << shift;
+    if ( !( c & 0x80 ) )
+      return x;
+    shift += 7;
+    c = next_input_byte(in);
+  }
+}
+
+static unsigned long long load_64(unsigned char *p) {
+  return (unsigned long long) p[ 0 ] | (unsigned long long) p[ 1 ] << 8 |
+    (unsigned long long) p[ 2 ] << 16 | (unsigned long long) p[ 3 ] << 24 |
+    (unsigned long long) p[ 4 ] << 32 | (unsigned long long) p[ 5 ] << 40 |
+    (unsigned long long) p[ 6 ] << 48 | (unsigned long long) p[ 7 ] << 56;
+}
+
+/*
+ * "bits" contiene los "count" bits siguientes del code-stream, el
+ * primero en la posicin menos significativa. Al rellenarlo se cargan
+ * 8 bytes de una vez y se avanzan slo los bytes completos que caben;
+ * los bits que sobrepasan "count" son los bytes siguientes del
+ * code-stream, de modo que volver a cargarlos ms tarde no altera su
+ * valor. Tras una recarga quedan al menos 56 bits.
+ */
+#define REFILL_BITS(in, bits, count) do {		\
+    if ( input_end - (in) < 8 )				\
+      (in) = reload_input(in);				\
+    (bits) |= load_64(in) << (count);			\
+    (in) += ( 63 - (count) ) >> 3;			\
+    (count) |= 56;					\
+  } while ( 0 )
+
+/*
+ * Lectura de las longitudes en modo cannico. Al terminar se descarta
+ * el resto del ltimo byte, como al final de cada bloque.
+ */
+static unsigned char *header_in;
+static unsigned long long header_input_bits;
+
+static int get_header_bits(int number_of_bits) {
+  int bits;
+  if ( header_count < number_of_bits )
+    REFILL_BITS(header_in, header_input_bits, header_count);
+  bits = header_input_bits & ( ( 1u << number_of_bits ) - 1 );
+  header_input_bits >>= number_of_bits;
+  header_count -= number_of_bits;
+  return bits;
+}
+
+/*
+ * Lectura de los code-streams de un bloque multi-stream, que se
+ * copian completos en memoria (seguidos de 16 bytes a cero) y no
+ * necesitan recargas.
+ */
+#define REFILL_STREAM(in, bits, count) do {		\
+    (bits) |= load_64(in) << (count);			\
+    (in) += ( 63 - (count) ) >> 3;			\
+    (count) |= 56;					\
+  } while ( 0 )
+
+#define DECODE_ENTRY(table, mask, bits, count, out) do {	\
+    unsigned int e_ = (table)[ (bits) & (mask) ];		\
+    (out)[ 0 ] = ENTRY_SYMBOL_1(e_);				\
+    (out)[ 1 ] = ENTRY_SYMBOL_2(e_);				\
+    (out) += ENTRY_SYMBOLS(e_);					\
+    (bits) >>= ENTRY_LENGTH(e_);				\
+    (count) -= ENTRY_LENGTH(e_);				\
+  } while ( 0 )
+
+/*
+ * Copia en "dest" los "n" bytes siguientes del code-stream.
+ */
+static unsigned char *read_input(unsigned char *in, unsigned char *dest,
+				 size_t n) {
+  size_t m;
+  while ( n > 0 ) {
+    if ( in >= input_end ) {
+      in = reload_input(in);
+      if ( in >= input_end ) {
+	fprintf(stderr, "huff: code-stream truncado\n");
+	exit(1);
       }
-    if ( min_2 == 513 )
-      break;
-    nodes[ next_free ].count = nodes[ min_1 ].count
-      + nodes[ min_2 ].count;
-    nodes[ min_1 ].count = 0;
-    nodes[ min_2 ].count = 0;
-    nodes[ next_free ].child_0 = min_1;
-    nodes[ next_free ].child_1 = min_2;
+    }
+    m = input_end - in;
+    if ( m > n )
+      m = n;
+    memcpy(dest, in, m);
+    in += m;
+    dest += m;
+    n -= m;
+  }
+  return in;
+}
+
+/*
+ * Descodifica, de uno en uno, los smbolos de un segmento que
+ * quedan hasta "end".
+ */
+static void finish_stream(unsigned int *table, unsigned int mask,
+			  unsigned char *in, unsigned long long bits,
+			  int count, unsigned char *out, unsigned char *end) {
+  unsigned int e;
+  while ( out < end ) {
+    REFILL_STREAM(in, bits, count);
+    e = table[ bits & mask ];
+    *out++ = ENTRY_SYMBOL_1(e);
+    bits >>= ENTRY_LENGTH_1(e);
+    count -= ENTRY_LENGTH_1(e);
+  }
+}
+
+/*
+ * Descodifica un bloque de "size" smbolos dividido en 4 code-streams.
+ * Los 4 lectores de bits se ejecutan en el mismo bucle y cada uno
+ * escribe en su propio segmento de "output", as que sus consultas a
+ * la tabla no dependen unas de otras. El bucle principal termina
+ * cuando a alguno de los segmentos le quedan menos de 2*lookups
+ * smbolos (una consulta puede producir dos), y el resto de cada
+ * segmento se descodifica de smbolo en smbolo.
+ */
+static unsigned char *decode_streams(unsigned char *in, size_t size,
+				     unsigned int *table, int table_bits) {
+  static unsigned char *payload, *output;
+  static size_t payload_size, output_size;
+  unsigned long long bits0, bits1, bits2, bits3;
+  unsigned char *in0, *in1, *in2, *in3;
+  unsigned char *out0, *out1, *out2, *out3;
+  unsigned char *end[STREAMS];
+  size_t stream_size[STREAMS], total, segment;
+  unsigned int mask;
+  int i, k, lookups, count0, count1, count2, count3;
+
+  total = 0;
+  for ( i = 0 ; i < STREAMS ; i++ ) {
+    stream_size[ i ] = input_varint(next_input_byte(&in), &in);
+    total += stream_size[ i ];
+  }
+  if ( payload_size < total + 16 ) {
+    free(payload);
+    payload_size = total + 16;
+    payload = malloc(payload_size);
+  }
+  if ( output_size < size + 16 ) {
+    free(output);
+    output_size = size + 16;
+    output = malloc(output_size);
+  }
+  if ( !payload || !output ) {
+    fprintf(stderr, "huff: memoria insuficiente\n");
+    exit(1);
+  }
+  in = read_input(in, payload, total);
+  memset(payload + total, 0, 16);
+
+  segment = ( size + STREAMS - 1 ) / STREAMS;
+  for ( i = 0 ; i < STREAMS ; i++ )
+    end[ i ] = output + ( i < STREAMS - 1 ? ( i + 1 )*segment : size );
+  in0 = payload;
+  in1 = in0 + stream_size[ 0 ];
+  in2 = in1 + stream_size[ 1 ];
+  in3 = in2 + stream_size[ 2 ];
+  out0 = output;
+  out1 = end[ 0 ];
+  out2 = end[ 1 ];
+  out3 = end[ 2 ];
+  bits0 = bits1 = bits2 = bits3 = 0;
+  count0 = count1 = count2 = count3 = 0;
+  mask = ( 1u << table_bits ) - 1;
+  lookups = 56 / table_bits;
+  while ( end[ 0 ] - out0 >= 2*lookups && end[ 1 ] - out1 >= 2*lookups &&
+	  end[ 2 ] - out2 >= 2*lookups && end[ 3 ] - out3 >= 2*lookups ) {
+    REFILL_STREAM(in0, bits0, count0);
+    REFILL_STREAM(in1, bits1, count1);
+    REFILL_STREAM(in2, bits2, count2);
+    REFILL_STREAM(in3, bits3, count3);
+    for ( k = 0 ; k < lookups ; k++ ) {
+      DECODE_ENTRY(table, mask, bits0, count0, out0);
+      DECODE_ENTRY(table, mask, bits1, count1, out1);
+      DECODE_ENTRY(table, mask, bits2, count2, out2);
+      DECODE_ENTRY(table, mask, bits3, count3, out3);
+    }
+  }
+  finish_stream(table, mask, in0, bits0, count0, out0, end[ 0 ]);
+  finish_stream(table, mask, in1, bits1, count1, out1, end[ 1 ]);
+  finish_stream(table, mask, in2, bits2, count2, out2, end[ 2 ]);
+  finish_stream(table, mask, in3, bits3, count3, out3, end[ 3 ]);
+  fwrite(output, 1, size, stdout);
+  return in;
+}
+
+/*
+ * Descompresin en modo cannico. Cada consulta a la tabla consume a
+ * lo sumo "table_bits" bits y produce uno o dos smbolos, por lo que
+ * tras cada recarga se pueden hacer 56/table_bits consultas. Al
+ * terminar un bloque se descartan los bits que quedan de su ltimo
+ * byte: de los "count" bits cargados, los count/8 bytes completos
+ * pertenecen ya al bloque siguiente.
+ */
+void decode_stream_canonical() {
+  static unsigned int table[1 << MAX_MAX_CODE_LENGTH];
+  static unsigned char output_buffer[IO_BUFFER_SIZE + 16];
+  unsigned long long remaining, bits;
+  unsigned char *out, *in;
+  unsigned int e, mask;
+  int lengths[256];
+  int i, c, table_bits, lookups, k, count;
+
+  in = input_end;
+  out = output_buffer;
+  while ( ( c = next_input_byte(&in) ) != EOF ) {
+    remaining = input_varint(c, &in);
+    /* La tabla tiene al menos DEFAULT_MAX_CODE_LENGTH bits para que
+       quepan dos cdigos en una misma entrada. */
+    header_in = in;
+    header_input_bits = 0;
+    header_count = 0;
+    input_lengths(lengths, 256, get_header_bits);
+    in = header_in - ( header_count >> 3 );
+    table_bits = DEFAULT_MAX_CODE_LENGTH;
+    for ( i = 0 ; i < 256 ; i++ )
+      if ( lengths[ i ] > table_bits )
+	table_bits = lengths[ i ];
+    build_decoding_table(lengths, 256, table, table_bits, LSB_FIRST);
+    if ( remaining >= MULTI_STREAM_MIN_SIZE ) {
+      fwrite(output_buffer, 1, out - output_buffer, stdout);
+      out = output_buffer;
+      in = decode_streams(in, remaining, table, table_bits);
+      continue;
+    }
+    mask = ( 1u << table_bits ) - 1;
+    lookups = 56 / table_bits;
+
+    bits = 0;
+    count = 0;
+    while ( remaining >= 2u*lookups ) {
+      REFILL_BITS(in, bits, count);
+      for ( k = 0 ; k < lookups ; k++ ) {
+	e = table[ bits & mask ];
+	out[ 0 ] = ENTRY_SYMBOL_1(e);
+	out[ 1 ] = ENTRY_SYMBOL_2(e);
+	out += ENTRY_SYMBOLS(e);
+	bits >>= ENTRY_LENGTH(e);
+	count -= ENTRY_LENGTH(e);
+	remaining -= ENTRY_SYMBOLS(e);
+      }
+      if ( out >= output_buffer + IO_BUFFER_SIZE ) {
+	fwrite(output_buffer, 1, out - output_buffer, stdout);
+	out = output_buffer;
+      }
+    }
+    /* Los ltimos smbolos se descodifican de uno en uno. */
+    while ( remaining > 0 ) {
+      REFILL_BITS(in, bits, count);
+      e = table[ bits & mask ];
+      *out++ = ENTRY_SYMBOL_1(e);
+      bits >>= ENTRY_LENGTH_1(e);
+      count -= ENTRY_LENGTH_1(e);
+      remaining--;
+    }
+    if ( out >= output_buffer + IO_BUFFER_SIZE ) {
+      fwrite(output_buffer, 1, out - output_buffer, stdout);
+      out = output_buffer;
+    }
+    in -= count >> 3;
   }
-  next_free--;
-  return next_free;
+  fwrite(output_buffer, 1, out - output_buffer, stdout);
 }
 
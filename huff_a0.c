@@ -9,12 +9,31 @@
  * D. A. Huffman, Proceedings of the Institute of Radio Engineers,
  * Vol. 40, pp. 1098-1101. 1952.
  * M. Nelson and J.-L. Gailly, The Data Compression Book. 1995.
+ *
+ * Uso:
+ *
+ * huff_a0 e [-p periodo | -v] < fichero > comprimido
+ * huff_a0 d [-p periodo | -v] < comprimido > fichero
+ *
+ * La opcin "-p" selecciona el modo semi-adaptativo: en lugar de
+ * actualizar el rbol tras cada smbolo, se reconstruye un cdigo
+ * cannico a partir de los recuentos cada "periodo" smbolos. La
+ * opcin "-v" usa el algoritmo Lambda de Vitter en lugar del FGK; el
+ * cdigo resultante es algo ms corto, pero el FGK, con su cach de
+ * cdigos, comprime y descomprime aproximadamente el doble de rpido.
+ * Ambos modos se anotan en una cabecera del stream, as que el
+ * descompresor no necesita las opciones; si se le dan y no coinciden
+ * con las del stream, termina con un error.
+ *
+ * J. S. Vitter, "Design and Analysis of Dynamic Huffman Codes,"
+ * J. ACM, 34(4):825-845. 1987.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "bitio.h"
+#include "canonical.h"
 
 #define END_OF_STREAM     256
 #define ESCAPE            257
@@ -38,17 +57,27 @@
  * index is either an index pointing to a pair of children, or an
  * actual symbol value, depending on whether 'child_is_leaf' is true
  * or false.
+ *
+ * The encoder also keeps the last code sent for every symbol, so that
+ * it does not have to climb the tree again while the path of the
+ * leaf stays the same.  A code_size of 0 means that there is no valid
+ * code in the cache.  The cached flag of a node is set when a leaf
+ * below it may have a code in the cache, so that only those subtrees
+ * have to be visited when the cache is invalidated.
  */
 
 typedef struct tree {
   int leaf[ SYMBOL_COUNT ];
   int next_free_node;
+  unsigned long code[ SYMBOL_COUNT ];
+  int code_size[ SYMBOL_COUNT ];
   struct node {
     unsigned int weight;
     int parent;
     int child_is_leaf;
     int child;
   } nodes[ NODE_TABLE_COUNT ];
+  unsigned char cached[ NODE_TABLE_COUNT ];
 } TREE;
 
 /*
@@ -60,6 +89,108 @@ typedef struct tree {
 
 TREE Tree;
 
+/*
+ * In the semi-adaptive mode, the model is just the count of every
+ * symbol, and the code is a canonical Huffman code built from those
+ * counts. The code is only rebuilt every "period" symbols, so in
+ * between both sides code with fixed tables: the encoder looks up
+ * the code of each symbol, and the decoder looks up the symbol in a
+ * table indexed with the next PERIODIC_MAX_LENGTH bits of the input.
+ * The first period is short so the code adapts quickly at the start
+ * of the stream; it then doubles until it reaches the period given
+ * by the user. As in the FGK tree, the counts are halved when their
+ * sum reaches MAX_WEIGHT, so old statistics are slowly forgotten.
+ *
+ * Every symbol starts with a count of 1, so no ESCAPE symbol is
+ * needed.
+ */
+#define PERIODIC_SYMBOLS     ( END_OF_STREAM + 1 )
+#define PERIODIC_MAX_LENGTH  11
+#define FIRST_PERIOD         64
+#define DEFAULT_PERIOD       4096
+
+typedef struct periodic_model {
+  unsigned long counts[ PERIODIC_SYMBOLS ];
+  unsigned long total;
+  CODE codes[ PERIODIC_SYMBOLS ];
+  unsigned int table[ 1 << PERIODIC_MAX_LENGTH ];
+  int period;
+  int max_period;
+  int left;
+  int decoding;
+} PERIODIC_MODEL;
+
+PERIODIC_MODEL Model;
+
+int parse_period( int argc, char *argv[] );
+void InitializePeriodicModel( PERIODIC_MODEL *model, int max_period,
+                              int decoding );
+void UpdatePeriodicModel( PERIODIC_MODEL *model, int c );
+void EncodePeriodic( PERIODIC_MODEL *model, int c );
+int DecodePeriodic( PERIODIC_MODEL *model );
+
+/*
+ * Vitter's algorithm Lambda. Nodes are kept in their implicit
+ * numbering: the slot of a node is its position in a bottom-up,
+ * left-to-right, level-order traversal of the tree, so the root is
+ * in the last slot and the 0-node (the leaf that stands for every
+ * symbol not yet seen) in the lowest one in use. Along the numbering
+ * the weights never decrease and, for each weight, the leaves come
+ * before the internal nodes. Each run of nodes with the same weight
+ * and kind is a block, and the weight is stored once per block,
+ * together with the block's leader (its highest slot). The node
+ * arrays only hold 16-bit links, one array per field, so an update
+ * that walks from a leaf to the root touches a few short arrays
+ * instead of 16-byte records. The weights are 16-bit too: as in the
+ * FGK tree, they are halved and the tree rebuilt when the weight of
+ * the root reaches MAX_WEIGHT.
+ *
+ * A new symbol is sent as the code of the 0-node followed by the
+ * symbol in 9 bits. END_OF_STREAM is sent the same way, so it never
+ * takes a leaf.
+ */
+#define LAMBDA_LEAVES   ( END_OF_STREAM + 1 )
+#define LAMBDA_NODES    ( 2 * LAMBDA_LEAVES - 1 )
+#define LAMBDA_ROOT     ( LAMBDA_NODES - 1 )
+#define LEAF            0x8000
+#define NO_NODE         0xFFFF
+
+typedef struct lambda_tree {
+  unsigned short parent[ LAMBDA_NODES ];
+  unsigned short child_0[ LAMBDA_NODES ];  /* LEAF | symbol in a leaf */
+  unsigned short child_1[ LAMBDA_NODES ];
+  unsigned short block[ LAMBDA_NODES ];
+  unsigned short leaf[ ESCAPE + 1 ];
+  unsigned short zero_node;
+  unsigned short weight[ LAMBDA_NODES ];   /* Per block. */
+  unsigned short leader[ LAMBDA_NODES ];   /* Per block. */
+  unsigned char block_is_leaf[ LAMBDA_NODES ];
+  unsigned short free_block[ LAMBDA_NODES ];
+  int free_blocks;
+} LAMBDA_TREE;
+
+LAMBDA_TREE Lambda;
+
+/*
+ * The FGK stream has no header, so it stays the classic format. The
+ * other modes start with a mode byte from 1 to 127, followed in the
+ * semi-adaptive mode by the period in 32 bits. A classic stream can
+ * not start that way: its first bit is 0 only when the first code is
+ * END_OF_STREAM, and then the rest of the byte is padding.
+ */
+#define FGK_MODE       0
+#define PERIODIC_MODE  1
+#define LAMBDA_MODE    2
+
+void WriteModeHeader( int mode, int period );
+void ReadModeHeader( int argc, char *argv[], int *mode, int *period );
+
+int has_option( int argc, char *argv[], char *option );
+void InitializeLambda( LAMBDA_TREE *tree );
+void EncodeLambda( LAMBDA_TREE *tree, int c );
+int DecodeLambda( LAMBDA_TREE *tree );
+void UpdateLambda( LAMBDA_TREE *tree, int c );
+
 /*
  * The high level view of the compression routine is very simple.
  * First, we initialize the Huffman tree, with just the ESCAPE and
@@ -76,7 +207,31 @@ TREE Tree;
 
 void encode_stream(int argc, char *argv[]) {
   int c;
+  int period;
   
+  period = parse_period( argc, argv );
+  if ( period ) {
+    WriteModeHeader( PERIODIC_MODE, period );
+    InitializePeriodicModel( &Model, period, FALSE );
+    while ( ( c = getchar() ) != EOF ) {
+      EncodePeriodic( &Model, c );
+      UpdatePeriodicModel( &Model, c );
+    }
+    EncodePeriodic( &Model, END_OF_STREAM );
+    flush();
+    return;
+  }
+  if ( has_option( argc, argv, "-v" ) ) {
+    WriteModeHeader( LAMBDA_MODE, 0 );
+    InitializeLambda( &Lambda );
+    while ( ( c = getchar() ) != EOF ) {
+      EncodeLambda( &Lambda, c );
+      UpdateLambda( &Lambda, c );
+    }
+    EncodeLambda( &Lambda, END_OF_STREAM );
+    flush();
+    return;
+  }
   InitializeTree( &Tree );
   while ( ( c = getchar() ) != EOF ) {
     EncodeSymbol( &Tree, c );
@@ -91,7 +246,8 @@ void encode_stream(int argc, char *argv[]) {
  * It first initializes the Huffman tree, using the same routine as
  * the compressor did.  It then sits in a loop, decoding characters and
  * updating the model until it reads in an END_OF_STREAM symbol.  At
- * that point, it is time to quit.
+ * that point, it is time to quit.  The model to use comes from the
+ * mode header, not from the command line.
  *
  * This routine will accept a single additional argument.  If the user
  * passes a "-d" argument, the function will dump out the Huffman tree
@@ -100,7 +256,26 @@ void encode_stream(int argc, char *argv[]) {
 
 void decode_stream(int argc, char *argv[]) {
   int c;
+  int mode;
+  int period;
   
+  ReadModeHeader( argc, argv, &mode, &period );
+  if ( mode == PERIODIC_MODE ) {
+    InitializePeriodicModel( &Model, period, TRUE );
+    while ( ( c = DecodePeriodic( &Model ) ) != END_OF_STREAM ) {
+      putchar(c);
+      UpdatePeriodicModel( &Model, c );
+    }
+    return;
+  }
+  if ( mode == LAMBDA_MODE ) {
+    InitializeLambda( &Lambda );
+    while ( ( c = DecodeLambda( &Lambda ) ) != END_OF_STREAM ) {
+      putchar(c);
+      UpdateLambda( &Lambda, c );
+    }
+    return;
+  }
   InitializeTree( &Tree );
   while ( ( c = DecodeSymbol( &Tree ) ) != END_OF_STREAM ) {
     putchar(c);
@@ -149,6 +324,10 @@ InitializeTree( TREE *tree ) {
   for ( i = 0 ; i < END_OF_STREAM ; i++ ) {
     tree->leaf[ i ] = -1;
   }
+  for ( i = 0 ; i < SYMBOL_COUNT ; i++ )
+    tree->code_size[ i ] = 0;
+  for ( i = 0 ; i < NODE_TABLE_COUNT ; i++ )
+    tree->cached[ i ] = FALSE;
 }
 
 /*
@@ -161,6 +340,9 @@ InitializeTree( TREE *tree ) {
  * we keep our codes in a long integer, so the maximum count is set
  * to an arbitray limit of 0x8000.  It could be set as high as 65535
  * if desired.
+ *
+ * The code found is saved in the cache, and used as is the next time
+ * the symbol comes, unless the tree has been changed around its leaf.
  */
 
 EncodeSymbol( TREE *tree, unsigned int c ) {
@@ -168,21 +350,26 @@ EncodeSymbol( TREE *tree, unsigned int c ) {
   unsigned long current_bit;
   int code_size;
   int current_node;
+  int symbol;
   
-  code = 0;
-  current_bit = 1;
-  code_size = 0;
-  current_node = tree->leaf[ c ];
-  if ( current_node == -1 )
-    current_node = tree->leaf[ ESCAPE ];
-  while ( current_node != ROOT_NODE ) {
-    if ( ( current_node & 1 ) == 0 )
-      code |= current_bit;
-    current_bit <<= 1;
-    code_size++;
-    current_node = tree->nodes[ current_node ].parent;
-  };
-  put_bits(code, code_size);
+  symbol = ( tree->leaf[ c ] == -1 ) ? ESCAPE : c;
+  if ( tree->code_size[ symbol ] == 0 ) {
+    code = 0;
+    current_bit = 1;
+    code_size = 0;
+    current_node = tree->leaf[ symbol ];
+    while ( current_node != ROOT_NODE ) {
+      if ( ( current_node & 1 ) == 0 )
+        code |= current_bit;
+      current_bit <<= 1;
+      code_size++;
+      tree->cached[ current_node ] = TRUE;
+      current_node = tree->nodes[ current_node ].parent;
+    };
+    tree->code[ symbol ] = code;
+    tree->code_size[ symbol ] = code_size;
+  }
+  put_bits(tree->code[ symbol ], tree->code_size[ symbol ]);
   if ( tree->leaf[ c ] == -1 ) {
     put_bits(c, 8);
     add_new_node( tree, c );
@@ -303,6 +490,13 @@ RebuildTree( TREE * tree ) {
     tree->nodes[ k ].child = i;
     tree->nodes[ k ].child_is_leaf = FALSE;
   }
+  /*
+   * Every code may have changed, so the whole cache goes away.
+   */
+  for ( i = 0 ; i < SYMBOL_COUNT ; i++ )
+    tree->code_size[ i ] = 0;
+  for ( i = 0 ; i < NODE_TABLE_COUNT ; i++ )
+    tree->cached[ i ] = FALSE;
   /*
    * The final step in tree reconstruction is to go through and set up
    * all of the leaf and parent members.  This can be safely done now
@@ -319,6 +513,38 @@ RebuildTree( TREE * tree ) {
   }
 }
 
+/*
+ * Moving a node changes the codes of all the leaves below it, so
+ * their entries in the code cache are dropped.  Only the nodes with
+ * the cached flag set are visited, and the flag is cleared on the
+ * way.  The stack can not hold more than one pending node per level
+ * of the tree.
+ */
+static void invalidate_codes( TREE *tree, int node ) {
+  int stack[ NODE_TABLE_COUNT ];
+  int top;
+
+  if ( tree->nodes[ node ].child_is_leaf ) {
+    tree->cached[ node ] = FALSE;
+    tree->code_size[ tree->nodes[ node ].child ] = 0;
+    return;
+  }
+  top = 0;
+  stack[ top++ ] = node;
+  while ( top > 0 ) {
+    node = stack[ --top ];
+    if ( !tree->cached[ node ] )
+      continue;
+    tree->cached[ node ] = FALSE;
+    if ( tree->nodes[ node ].child_is_leaf )
+      tree->code_size[ tree->nodes[ node ].child ] = 0;
+    else {
+      stack[ top++ ] = tree->nodes[ node ].child;
+      stack[ top++ ] = tree->nodes[ node ].child + 1;
+    }
+  }
+}
+
 /*
  * Swapping nodes takes place when a node has grown too big for its
  * spot in the tree.  When swapping nodes i and j, we rearrange the
@@ -327,6 +553,10 @@ RebuildTree( TREE * tree ) {
 swap_nodes( TREE * tree, int i, int j ) {
   struct node temp;
   
+  if ( tree->cached[ i ] )
+    invalidate_codes( tree, i );
+  if ( tree->cached[ j ] )
+    invalidate_codes( tree, j );
   if ( tree->nodes[ i ].child_is_leaf )
     tree->leaf[ tree->nodes[ i ].child ] = j;
   else {
@@ -378,4 +608,452 @@ add_new_node( TREE *tree, int c ) {
   tree->nodes[ zero_weight_node ].weight          = 0;
   tree->nodes[ zero_weight_node ].parent          = lightest_node;
   tree->leaf[ c ] = zero_weight_node;
+  tree->code_size[ tree->nodes[ new_node ].child ] = 0;
+  tree->cached[ new_node ] = FALSE;
+  tree->cached[ zero_weight_node ] = FALSE;
+}
+
+/*
+ * Returns the period given with "-p", or 0 if the semi-adaptive mode
+ * was not selected.
+ */
+int parse_period( int argc, char *argv[] ) {
+  int i;
+  int period = 0;
+
+  for ( i = 2 ; i < argc ; i++ )
+    if ( strcmp( argv[ i ], "-p" ) == 0 ) {
+      period = DEFAULT_PERIOD;
+      if ( i + 1 < argc && argv[ i + 1 ][ 0 ] != '-' )
+        period = atoi( argv[ ++i ] );
+      if ( period <= 0 ) {
+        fprintf( stderr, "huff_a0: el periodo debe ser positivo\n" );
+        exit( 1 );
+      }
+    }
+  return period;
+}
+
+/*
+ * Builds the code (and, when decoding, the decoding table) from the
+ * current counts. Lengths are limited to PERIODIC_MAX_LENGTH bits so
+ * that the decoding table stays small enough to be rebuilt often.
+ */
+RebuildPeriodicCode( PERIODIC_MODEL *model ) {
+  int lengths[ PERIODIC_SYMBOLS ];
+  int i;
+
+  if ( model->total >= MAX_WEIGHT ) {
+    model->total = 0;
+    for ( i = 0 ; i < PERIODIC_SYMBOLS ; i++ ) {
+      model->counts[ i ] = ( model->counts[ i ] + 1 ) / 2;
+      model->total += model->counts[ i ];
+    }
+  }
+  compute_lengths( model->counts, PERIODIC_SYMBOLS, lengths,
+                   PERIODIC_MAX_LENGTH );
+  if ( model->decoding )
+    build_decoding_table( lengths, PERIODIC_SYMBOLS, model->table,
+                          PERIODIC_MAX_LENGTH, MSB_FIRST );
+  else
+    assign_canonical_codes( lengths, PERIODIC_SYMBOLS, model->codes );
+}
+
+void InitializePeriodicModel( PERIODIC_MODEL *model, int max_period,
+                              int decoding ) {
+  int i;
+
+  model->decoding = decoding;
+  for ( i = 0 ; i < PERIODIC_SYMBOLS ; i++ )
+    model->counts[ i ] = 1;
+  model->total = PERIODIC_SYMBOLS;
+  model->max_period = max_period;
+  model->period = FIRST_PERIOD < max_period ? FIRST_PERIOD : max_period;
+  model->left = model->period;
+  RebuildPeriodicCode( model );
+}
+
+/*
+ * Counting a symbol is all the per-symbol work the model needs. The
+ * code is only rebuilt when the current period is over.
+ */
+void UpdatePeriodicModel( PERIODIC_MODEL *model, int c ) {
+  model->counts[ c ]++;
+  model->total++;
+  if ( --model->left == 0 ) {
+    if ( model->period < model->max_period ) {
+      model->period *= 2;
+      if ( model->period > model->max_period )
+        model->period = model->max_period;
+    }
+    model->left = model->period;
+    RebuildPeriodicCode( model );
+  }
+}
+
+void EncodePeriodic( PERIODIC_MODEL *model, int c ) {
+  put_bits( model->codes[ c ].code, model->codes[ c ].code_bits );
+}
+
+/*
+ * The next PERIODIC_MAX_LENGTH bits always contain a whole code, so a
+ * single table lookup gives the symbol and the number of bits that
+ * have to be consumed.
+ */
+int DecodePeriodic( PERIODIC_MODEL *model ) {
+  unsigned int entry;
+
+  entry = model->table[ peek_bits( PERIODIC_MAX_LENGTH ) ];
+  skip_bits( ENTRY_LENGTH_1( entry ) );
+  return ENTRY_SYMBOL_1( entry );
+}
+
+void WriteModeHeader( int mode, int period ) {
+  put_bits( mode, 8 );
+  if ( mode == PERIODIC_MODE ) {
+    put_bits( ( period >> 16 ) & 0xFFFF, 16 );
+    put_bits( period & 0xFFFF, 16 );
+  }
+}
+
+/*
+ * Reads the mode (and period) of the stream, and checks them against
+ * the options, if any were given to the decoder.
+ */
+void ReadModeHeader( int argc, char *argv[], int *mode, int *period ) {
+  int option_mode;
+  int option_period;
+
+  option_period = parse_period( argc, argv );
+  if ( option_period )
+    option_mode = PERIODIC_MODE;
+  else if ( has_option( argc, argv, "-v" ) )
+    option_mode = LAMBDA_MODE;
+  else
+    option_mode = FGK_MODE;
+  *mode = peek_bits( 8 );
+  *period = 0;
+  if ( *mode == 0 || *mode > 127 )
+    *mode = FGK_MODE;
+  else {
+    skip_bits( 8 );
+    if ( *mode == PERIODIC_MODE ) {
+      *period = get_bits( 16 ) << 16;
+      *period |= get_bits( 16 );
+    }
+    if ( ( *mode != PERIODIC_MODE && *mode != LAMBDA_MODE ) ||
+         ( *mode == PERIODIC_MODE && *period <= 0 ) ) {
+      fprintf( stderr, "huff_a0: cabecera incorrecta\n" );
+      exit( 1 );
+    }
+  }
+  if ( ( option_mode != FGK_MODE && option_mode != *mode ) ||
+       ( option_period && option_period != *period ) ) {
+    fprintf( stderr, "huff_a0: el stream no se comprimi con esas opciones\n" );
+    exit( 1 );
+  }
+}
+
+int has_option( int argc, char *argv[], char *option ) {
+  int i;
+
+  for ( i = 2 ; i < argc ; i++ )
+    if ( strcmp( argv[ i ], option ) == 0 )
+      return TRUE;
+  return FALSE;
+}
+
+/*
+ * Block bookkeeping for algorithm Lambda. Block numbers are recycled
+ * through a stack of free blocks.
+ */
+static int NewBlock( LAMBDA_TREE *tree, unsigned int weight, int is_leaf,
+                     int leader ) {
+  int b;
+
+  b = tree->free_block[ --tree->free_blocks ];
+  tree->weight[ b ] = weight;
+  tree->block_is_leaf[ b ] = is_leaf;
+  tree->leader[ b ] = leader;
+  return b;
+}
+
+static void FreeBlock( LAMBDA_TREE *tree, int b ) {
+  tree->free_block[ tree->free_blocks++ ] = b;
+}
+
+#define IS_LEAF( tree, k )     ( ( tree )->child_0[ k ] & LEAF )
+#define WEIGHT( tree, k )      ( ( tree )->weight[ ( tree )->block[ k ] ] )
+
+/*
+ * Initially the tree is just the 0-node, which is also the root, so
+ * the first symbol costs no bits besides its 9-bit value.
+ */
+void InitializeLambda( LAMBDA_TREE *tree ) {
+  int i;
+
+  tree->free_blocks = 0;
+  for ( i = LAMBDA_NODES - 1 ; i >= 0 ; i-- )
+    tree->free_block[ tree->free_blocks++ ] = i;
+  for ( i = 0 ; i <= ESCAPE ; i++ )
+    tree->leaf[ i ] = NO_NODE;
+  tree->zero_node = LAMBDA_ROOT;
+  tree->parent[ LAMBDA_ROOT ] = NO_NODE;
+  tree->child_0[ LAMBDA_ROOT ] = LEAF | ESCAPE;
+  tree->leaf[ ESCAPE ] = LAMBDA_ROOT;
+  tree->block[ LAMBDA_ROOT ] = NewBlock( tree, 0, TRUE, LAMBDA_ROOT );
+}
+
+/*
+ * As in EncodeSymbol(), the code is collected walking up from the
+ * leaf. A node is the 1 child of its parent when it is its child_1.
+ * With the weight of the root below MAX_WEIGHT the tree is less than
+ * 32 levels deep.
+ */
+void EncodeLambda( LAMBDA_TREE *tree, int c ) {
+  unsigned int code;
+  int code_size;
+  int node;
+  int parent;
+
+  code = 0;
+  code_size = 0;
+  node = tree->leaf[ c ];
+  if ( node == NO_NODE )
+    node = tree->zero_node;
+  while ( ( parent = tree->parent[ node ] ) != NO_NODE ) {
+    if ( tree->child_1[ parent ] == node )
+      code |= 1u << code_size;
+    code_size++;
+    node = parent;
+  }
+  if ( code_size > 16 ) {
+    put_bits( (int) ( ( code >> 16 ) & 0xFFFF ), code_size - 16 );
+    code_size = 16;
+  }
+  put_bits( (int) ( code & 0xFFFF ), code_size );
+  if ( tree->leaf[ c ] == NO_NODE )
+    put_bits( c, 9 );
+}
+
+int DecodeLambda( LAMBDA_TREE *tree ) {
+  int node;
+
+  node = LAMBDA_ROOT;
+  while ( !IS_LEAF( tree, node ) )
+    node = get_bit() ? tree->child_1[ node ] : tree->child_0[ node ];
+  if ( node == tree->zero_node )
+    return get_bits( 9 );
+  return tree->child_0[ node ] & ~LEAF;
+}
+
+/*
+ * Moves the node (the subtree) at "from" to "to". Links that point
+ * to the node are updated; the slot's own parent link is not, since
+ * it belongs to the slot.
+ */
+static void MoveNode( LAMBDA_TREE *tree, int from, int to ) {
+  tree->child_0[ to ] = tree->child_0[ from ];
+  tree->child_1[ to ] = tree->child_1[ from ];
+  tree->block[ to ] = tree->block[ from ];
+  if ( IS_LEAF( tree, to ) )
+    tree->leaf[ tree->child_0[ to ] & ~LEAF ] = to;
+  else {
+    tree->parent[ tree->child_0[ to ] ] = to;
+    tree->parent[ tree->child_1[ to ] ] = to;
+  }
+}
+
+/*
+ * Increments the weight of the node at slot "p". Before that, the node
+ * slides past the nodes that its new weight puts behind it: a leaf of
+ * weight w (always the leader of its block) passes the block of
+ * internal nodes of weight w, and an internal node of weight w passes
+ * the rest of its block and the block of leaves of weight w + 1. Those
+ * nodes move down one slot each. Returns the next node to increment:
+ * the new parent of a leaf, or the former parent of an internal node.
+ */
+static int SlideAndIncrement( LAMBDA_TREE *tree, int p ) {
+  int b, next_b, passed, to, k, is_leaf, former_parent;
+  unsigned short child_0, child_1;
+  unsigned int weight;
+
+  b = tree->block[ p ];
+  weight = tree->weight[ b ];
+  is_leaf = tree->block_is_leaf[ b ];
+  to = tree->leader[ b ];
+  passed = NO_NODE;
+  if ( to < LAMBDA_ROOT ) {
+    next_b = tree->block[ to + 1 ];
+    if ( tree->block_is_leaf[ next_b ] != is_leaf &&
+         tree->weight[ next_b ] == weight + !is_leaf ) {
+      passed = next_b;
+      to = tree->leader[ next_b ];
+    }
+  }
+  former_parent = tree->parent[ p ];
+
+  if ( to > p ) {
+    child_0 = tree->child_0[ p ];
+    child_1 = tree->child_1[ p ];
+    for ( k = p ; k < to ; k++ )
+      MoveNode( tree, k + 1, k );
+    tree->child_0[ to ] = child_0;
+    tree->child_1[ to ] = child_1;
+    if ( is_leaf )
+      tree->leaf[ child_0 & ~LEAF ] = to;
+    else
+      tree->parent[ child_0 ] = tree->parent[ child_1 ] = to;
+  }
+
+  /* The old block loses the node, and the passed block moves down. */
+  k = tree->leader[ b ] == p ? p - 1 : tree->leader[ b ] - 1;
+  if ( k >= 0 && tree->block[ k ] == b )
+    tree->leader[ b ] = k;
+  else
+    FreeBlock( tree, b );
+  if ( passed != NO_NODE )
+    tree->leader[ passed ]--;
+
+  /* The node joins the block above it, or starts a new one. */
+  weight++;
+  if ( to < LAMBDA_ROOT &&
+       tree->block_is_leaf[ tree->block[ to + 1 ] ] == is_leaf &&
+       tree->weight[ tree->block[ to + 1 ] ] == weight )
+    tree->block[ to ] = tree->block[ to + 1 ];
+  else
+    tree->block[ to ] = NewBlock( tree, weight, is_leaf, to );
+
+  return is_leaf ? tree->parent[ to ] : former_parent;
+}
+
+/*
+ * Halves the weights of the leaves, rounding up so no seen symbol
+ * drops to 0, and rebuilds the tree with the two-queue Huffman
+ * construction. The leaves, taken in slot order, are already sorted
+ * by weight, and the internal nodes come out sorted too. Each node
+ * takes the next slot when it is picked, so siblings are adjacent,
+ * the root ends in the last slot, and picking the leaf on a tie puts
+ * the leaves of each weight before the internal nodes. The blocks
+ * are then rebuilt from the runs of equal weight and kind.
+ */
+static void RebuildLambda( LAMBDA_TREE *tree ) {
+  unsigned short weight[ LAMBDA_NODES ];
+  unsigned short child_0[ LAMBDA_NODES ];
+  unsigned short child_1[ LAMBDA_NODES ];
+  unsigned short slot[ LAMBDA_NODES ];
+  unsigned short slot_weight[ LAMBDA_NODES ];
+  int leaves, nodes, next_leaf, next_internal, next_slot;
+  int pair[ 2 ];
+  int i, k, s, b, is_leaf;
+
+  leaves = 0;
+  for ( k = tree->zero_node ; k <= LAMBDA_ROOT ; k++ )
+    if ( IS_LEAF( tree, k ) ) {
+      child_0[ leaves ] = tree->child_0[ k ];
+      weight[ leaves++ ] = ( WEIGHT( tree, k ) + 1 ) / 2;
+    }
+  nodes = 2 * leaves - 1;
+  next_leaf = 0;
+  next_internal = leaves;
+  next_slot = LAMBDA_ROOT - nodes + 1;
+  for ( i = leaves ; i < nodes ; i++ ) {
+    for ( s = 0 ; s < 2 ; s++ ) {
+      if ( next_internal == i ||
+           ( next_leaf < leaves &&
+             weight[ next_leaf ] <= weight[ next_internal ] ) )
+        k = next_leaf++;
+      else
+        k = next_internal++;
+      slot[ k ] = next_slot++;
+      pair[ s ] = k;
+    }
+    child_0[ i ] = pair[ 0 ];
+    child_1[ i ] = pair[ 1 ];
+    weight[ i ] = weight[ pair[ 0 ] ] + weight[ pair[ 1 ] ];
+  }
+  slot[ nodes - 1 ] = LAMBDA_ROOT;
+
+  for ( i = 0 ; i < nodes ; i++ ) {
+    k = slot[ i ];
+    slot_weight[ k ] = weight[ i ];
+    if ( i < leaves ) {
+      tree->child_0[ k ] = child_0[ i ];
+      tree->leaf[ child_0[ i ] & ~LEAF ] = k;
+    } else {
+      tree->child_0[ k ] = slot[ child_0[ i ] ];
+      tree->child_1[ k ] = slot[ child_1[ i ] ];
+      tree->parent[ slot[ child_0[ i ] ] ] = k;
+      tree->parent[ slot[ child_1[ i ] ] ] = k;
+    }
+  }
+  tree->parent[ LAMBDA_ROOT ] = NO_NODE;
+  tree->zero_node = tree->leaf[ ESCAPE ];
+
+  tree->free_blocks = 0;
+  for ( i = LAMBDA_NODES - 1 ; i >= 0 ; i-- )
+    tree->free_block[ tree->free_blocks++ ] = i;
+  b = NO_NODE;
+  for ( k = tree->zero_node ; k <= LAMBDA_ROOT ; k++ ) {
+    is_leaf = IS_LEAF( tree, k ) ? TRUE : FALSE;
+    if ( b != NO_NODE && tree->block_is_leaf[ b ] == is_leaf &&
+         tree->weight[ b ] == slot_weight[ k ] )
+      tree->leader[ b ] = k;
+    else
+      b = NewBlock( tree, slot_weight[ k ], is_leaf, k );
+    tree->block[ k ] = b;
+  }
+}
+
+/*
+ * The update follows Vitter's procedure. A new symbol splits the
+ * 0-node into an internal node whose children are a new 0-node and
+ * the new leaf, both of weight 0. Otherwise the leaf is first
+ * exchanged with the leader of its block. If the leaf is then the
+ * sibling of the 0-node, its parent has the same weight, so the
+ * parent is incremented first and the leaf last.
+ */
+void UpdateLambda( LAMBDA_TREE *tree, int c ) {
+  int q, leader, zero, b, leaf_to_increment;
+  unsigned short symbol;
+
+  if ( WEIGHT( tree, LAMBDA_ROOT ) == MAX_WEIGHT )
+    RebuildLambda( tree );
+  leaf_to_increment = NO_NODE;
+  q = tree->leaf[ c ];
+  if ( q == NO_NODE ) {
+    zero = tree->zero_node;
+    b = tree->block[ zero ];
+    tree->child_0[ zero ] = zero - 2;
+    tree->child_1[ zero ] = zero - 1;
+    tree->block[ zero ] = NewBlock( tree, 0, FALSE, zero );
+    tree->parent[ zero - 1 ] = tree->parent[ zero - 2 ] = zero;
+    tree->child_0[ zero - 1 ] = LEAF | c;
+    tree->child_0[ zero - 2 ] = LEAF | ESCAPE;
+    tree->block[ zero - 1 ] = tree->block[ zero - 2 ] = b;
+    tree->leader[ b ] = zero - 1;
+    tree->leaf[ c ] = zero - 1;
+    tree->leaf[ ESCAPE ] = zero - 2;
+    tree->zero_node = zero - 2;
+    q = zero;
+    leaf_to_increment = zero - 1;
+  } else {
+    leader = tree->leader[ tree->block[ q ] ];
+    if ( leader != q ) {
+      symbol = tree->child_0[ leader ];
+      tree->child_0[ leader ] = tree->child_0[ q ];
+      tree->child_0[ q ] = symbol;
+      tree->leaf[ symbol & ~LEAF ] = q;
+      tree->leaf[ c ] = leader;
+      q = leader;
+    }
+    if ( tree->parent[ q ] == tree->parent[ tree->zero_node ] ) {
+      leaf_to_increment = q;
+      q = tree->parent[ q ];
+    }
+  }
+  while ( q != NO_NODE )
+    q = SlideAndIncrement( tree, q );
+  if ( leaf_to_increment != NO_NODE )
+    SlideAndIncrement( tree, leaf_to_increment );
 }
@@ -0,0 +1,499 @@
+/*
+ * loco_i.c
+ *
+ * Un codificador de imgenes sin prdidas del tipo LOCO-I (el ncleo
+ * de JPEG-LS) para imgenes en escala de grises en formato PGM.
+ *
+ * Cada muestra se predice con el detector de bordes de la mediana
+ * (MED) a partir de sus vecinas "a" (izquierda), "b" (arriba), "c"
+ * (arriba-izquierda) y "d" (arriba-derecha). Los gradientes locales
+ * d-b, b-c y c-a se cuantifican para seleccionar uno de 365
+ * contextos, cada uno de los cuales mantiene sus propios recuentos
+ * para corregir el sesgo de la prediccin y estimar el parmetro del
+ * cdigo de Golomb-Rice que codifica el residuo (vase
+ * golomb_ctx.c). Cuando los tres
+ * gradientes son nulos (zona plana) se entra en el modo de
+ * "carreras", que codifica longitudes de carrera con un cdigo de
+ * Golomb adaptativo.
+ *
+ * La imagen se procesa fila a fila y slo se mantienen en memoria la
+ * fila actual y la anterior.
+ *
+ * Uso:
+ *
+ * loco_i e < imagen.pgm > imagen.loco
+ * loco_i d < imagen.loco > imagen.pgm
+ *
+ * Referencias:
+ *
+ * M. J. Weinberger, G. Seroussi and G. Sapiro, "The LOCO-I Lossless
+ * Image Compression Algorithm: Principles and Standardization into
+ * JPEG-LS," IEEE Trans. Image Processing, vol. 9, no. 8,
+ * pp. 1309--1324, Aug. 2000.
+ *
+ * ITU-T Rec. T.87 | ISO/IEC 14495-1, "Lossless and near-lossless
+ * compression of continuous-tone still images - Baseline", 1998.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bitio.h"
+#include "golomb_ctx.h"
+#include "codec.h"
+
+/* Nmero de contextos del modo regular. */
+#define REGULAR_CONTEXTS 365
+
+/* Contextos de las muestras que interrumpen una carrera. */
+#define RUN_CONTEXT_0 365
+#define RUN_CONTEXT_1 366
+
+/* Nmero total de contextos. */
+#define CONTEXTS 367
+
+/* Cuando un contexto acumula RESET muestras, sus recuentos se dividen
+   entre dos. */
+#define RESET 64
+
+/* Rango de la correccin del sesgo de la prediccin. */
+#define MIN_C -128
+#define MAX_C 127
+
+/* Mximo valor de una muestra y parmetros que dependen de l. */
+static int maxval;
+static int range;    /* maxval+1 */
+static int qbpp;     /* Bits necesarios para representar un residuo. */
+static int limit;    /* Longitud mxima de un cdigo de Golomb. */
+static int t1, t2, t3; /* Umbrales de cuantificacin de los gradientes. */
+
+/* Estadsticas de los contextos. "A" acumula las magnitudes de los
+   residuos, "B" los residuos (sesgo), "C" es la correccin de la
+   prediccin, "N" el nmero de ocurrencias y "Nn" el nmero de
+   residuos negativos (slo en los contextos de carrera). */
+static int A[CONTEXTS];
+static int B[REGULAR_CONTEXTS];
+static int C[REGULAR_CONTEXTS];
+static int N[CONTEXTS];
+static int Nn[CONTEXTS];
+
+/* Orden del cdigo de las longitudes de carrera. */
+static const int J[32] = {
+  0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+  4, 4, 5, 5, 6, 6, 7, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+static int run_index;
+
+/* Fila anterior y fila actual. Ambas tienen una posicin extra a
+   cada lado para simplificar el tratamiento de los bordes. */
+static int *prev_row, *cur_row;
+static int width, height;
+
+/* Nmero de bits necesarios para representar valores en [0, n). */
+static int bits_for(int n) {
+  int b = 0;
+  while((1<<b) < n) b++;
+  return b;
+}
+
+static int clamp(int x, int lo, int hi) {
+  if(x<lo || x>hi) return lo;
+  return x;
+}
+
+/* Calcula los parmetros que dependen de "maxval" (los valores por
+   defecto del estndar, sin prdidas). */
+static void init_parameters() {
+  int bpp, factor;
+  range = maxval + 1;
+  qbpp = bits_for(range);
+  bpp = qbpp < 2 ? 2 : qbpp;
+  limit = 2*(bpp + (bpp > 8 ? bpp : 8));
+  if(maxval >= 128) {
+    factor = ((maxval > 4095 ? 4095 : maxval) + 128) >> 8;
+    t1 = clamp(factor*(3-2) + 2, 1, maxval);
+    t2 = clamp(factor*(7-3) + 3, t1, maxval);
+    t3 = clamp(factor*(21-4) + 4, t2, maxval);
+  } else {
+    factor = 256/(maxval + 1);
+    t1 = clamp(3/factor > 2 ? 3/factor : 2, 1, maxval);
+    t2 = clamp(7/factor > 3 ? 7/factor : 3, t1, maxval);
+    t3 = clamp(21/factor > 4 ? 21/factor : 4, t2, maxval);
+  }
+}
+
+/* Inicializa los contextos. */
+static void init_contexts() {
+  int i, a = (range + 32) >> 6;
+  if(a < 2) a = 2;
+  for(i=0; i<CONTEXTS; i++) {
+    A[i] = a;
+    N[i] = 1;
+    Nn[i] = 0;
+  }
+  for(i=0; i<REGULAR_CONTEXTS; i++) {
+    B[i] = 0;
+    C[i] = 0;
+  }
+  run_index = 0;
+}
+
+/* Reserva las dos filas. La fila "-1" (la anterior a la primera) es
+   toda ceros. */
+static void init_rows() {
+  int i;
+  prev_row = (int *)malloc((width+2)*sizeof(int));
+  cur_row = (int *)malloc((width+2)*sizeof(int));
+  if(!prev_row || !cur_row) {
+    fprintf(stderr, "loco_i: sin memoria\n");
+    exit(1);
+  }
+  for(i=0; i<width+2; i++) prev_row[i] = cur_row[i] = 0;
+  prev_row++;
+  cur_row++;
+}
+
+/* Intercambia las filas al terminar una. "Rd" en la ltima columna y
+   "Rc" en la primera se toman de la propia fila anterior. */
+static void next_row() {
+  int *tmp;
+  cur_row[width] = cur_row[width-1];
+  tmp = prev_row;
+  prev_row = cur_row;
+  cur_row = tmp;
+  cur_row[-1] = prev_row[0];
+}
+
+static void free_rows() {
+  free(prev_row-1);
+  free(cur_row-1);
+}
+
+/* Cuantifica un gradiente en una de 9 regiones (-4..4). */
+static int quantize(int d) {
+  if(d <= -t3) return -4;
+  if(d <= -t2) return -3;
+  if(d <= -t1) return -2;
+  if(d < 0) return -1;
+  if(d == 0) return 0;
+  if(d < t1) return 1;
+  if(d < t2) return 2;
+  if(d < t3) return 3;
+  return 4;
+}
+
+/* Predictor MED (Median Edge Detector). */
+static int predict(int a, int b, int c) {
+  int mx = a > b ? a : b;
+  int mn = a > b ? b : a;
+  if(c >= mx) return mn;
+  if(c <= mn) return mx;
+  return a + b - c;
+}
+
+/* Reduce el residuo mdulo "range" al intervalo
+   [-range/2, range/2). */
+static int reduce(int errval) {
+  if(errval < 0) errval += range;
+  if(errval >= (range+1)/2) errval -= range;
+  return errval;
+}
+
+/* Actualiza las estadsticas del contexto regular "q". */
+static void update_regular(int q, int errval) {
+  B[q] += errval;
+  A[q] += errval < 0 ? -errval : errval;
+  if(N[q] == RESET) {
+    A[q] >>= 1;
+    B[q] = B[q] >= 0 ? B[q] >> 1 : -((1-B[q]) >> 1);
+    N[q] >>= 1;
+  }
+  N[q]++;
+  if(B[q] <= -N[q]) {
+    B[q] += N[q];
+    if(C[q] > MIN_C) C[q]--;
+    if(B[q] <= -N[q]) B[q] = -N[q] + 1;
+  } else if(B[q] > 0) {
+    B[q] -= N[q];
+    if(C[q] < MAX_C) C[q]++;
+    if(B[q] > 0) B[q] = 0;
+  }
+}
+
+/* Actualiza las estadsticas de un contexto de carrera. */
+static void update_run(int q, int errval, int emerrval, int ritype) {
+  if(errval < 0) Nn[q]++;
+  A[q] += (emerrval + 1 - ritype) >> 1;
+  if(N[q] == RESET) {
+    A[q] >>= 1;
+    N[q] >>= 1;
+    Nn[q] >>= 1;
+  }
+  N[q]++;
+}
+
+/* Calcula el contexto regular a partir de los tres gradientes
+   cuantificados. El signo se normaliza para que el primer gradiente
+   no nulo sea positivo, con lo que los contextos "opuestos" se
+   fusionan. Devuelve 0 si los tres gradientes son nulos (modo de
+   carreras). */
+static int context(int d, int b, int c, int a, int *sign) {
+  int q1 = quantize(d - b);
+  int q2 = quantize(b - c);
+  int q3 = quantize(c - a);
+  *sign = 1;
+  if(q1 < 0 || (q1 == 0 && (q2 < 0 || (q2 == 0 && q3 < 0)))) {
+    q1 = -q1;
+    q2 = -q2;
+    q3 = -q3;
+    *sign = -1;
+  }
+  return 81*q1 + 9*q2 + q3;
+}
+
+/* Prediccin corregida con el sesgo del contexto. */
+static int corrected_prediction(int q, int sign, int a, int b, int c) {
+  int px = predict(a, b, c) + sign*C[q];
+  if(px > maxval) px = maxval;
+  if(px < 0) px = 0;
+  return px;
+}
+
+/* Codifica la muestra "x" en modo regular. */
+static void encode_regular(int q, int sign, int x, int a, int b, int c) {
+  int px, errval, k, m;
+  px = corrected_prediction(q, sign, a, b, c);
+  errval = x - px;
+  if(sign < 0) errval = -errval;
+  errval = reduce(errval);
+  k = golomb_parameter(N[q], A[q]);
+  if(k == 0 && 2*B[q] <= -N[q])
+    m = errval >= 0 ? 2*errval + 1 : -2*(errval + 1);
+  else
+    m = errval >= 0 ? 2*errval : -2*errval - 1;
+  put_golomb(m, k, limit, qbpp);
+  update_regular(q, errval);
+}
+
+static int decode_regular(int q, int sign, int a, int b, int c) {
+  int px, errval, k, m, x;
+  px = corrected_prediction(q, sign, a, b, c);
+  k = golomb_parameter(N[q], A[q]);
+  m = get_golomb(k, limit, qbpp);
+  if(k == 0 && 2*B[q] <= -N[q])
+    errval = (m & 1) ? (m - 1) >> 1 : -((m + 2) >> 1);
+  else
+    errval = (m & 1) ? -((m + 1) >> 1) : m >> 1;
+  update_regular(q, errval);
+  if(sign < 0) errval = -errval;
+  x = px + errval;
+  if(x < 0) x += range;
+  if(x > maxval) x -= range;
+  return x;
+}
+
+/* Codifica la muestra "x" que interrumpe una carrera. */
+static void encode_run_interruption(int x, int ra, int rb) {
+  int ritype = (ra == rb);
+  int q = ritype ? RUN_CONTEXT_1 : RUN_CONTEXT_0;
+  int px = ritype ? ra : rb;
+  int errval = x - px;
+  int temp, k, map, emerrval;
+  if(!ritype && ra > rb) errval = -errval;
+  errval = reduce(errval);
+  temp = ritype ? A[q] + (N[q] >> 1) : A[q];
+  k = golomb_parameter(N[q], temp);
+  if(k == 0 && errval > 0 && 2*Nn[q] < N[q]) map = 1;
+  else if(errval < 0 && 2*Nn[q] >= N[q]) map = 1;
+  else if(errval < 0 && k != 0) map = 1;
+  else map = 0;
+  emerrval = 2*(errval < 0 ? -errval : errval) - ritype - map;
+  put_golomb(emerrval, k, limit - J[run_index] - 1, qbpp);
+  update_run(q, errval, emerrval, ritype);
+}
+
+static int decode_run_interruption(int ra, int rb) {
+  int ritype = (ra == rb);
+  int q = ritype ? RUN_CONTEXT_1 : RUN_CONTEXT_0;
+  int px = ritype ? ra : rb;
+  int temp, k, map, emerrval, errval, x;
+  temp = ritype ? A[q] + (N[q] >> 1) : A[q];
+  k = golomb_parameter(N[q], temp);
+  emerrval = get_golomb(k, limit - J[run_index] - 1, qbpp);
+  map = (emerrval + ritype) & 1;
+  errval = (emerrval + ritype + map) >> 1;
+  if((k != 0 || 2*Nn[q] >= N[q]) == map) errval = -errval;
+  update_run(q, errval, emerrval, ritype);
+  if(!ritype && ra > rb) errval = -errval;
+  x = px + errval;
+  if(x < 0) x += range;
+  if(x > maxval) x -= range;
+  return x;
+}
+
+/* Codifica una carrera que comienza en la columna "x" de la fila
+   actual y la muestra que la interrumpe (si no se alcanza el final de
+   la fila). Devuelve la siguiente columna a codificar. */
+static int encode_run(int x) {
+  int runval = cur_row[x-1];
+  int count = 0;
+  while(x + count < width && cur_row[x + count] == runval) count++;
+  x += count;
+  while(count >= (1<<J[run_index])) {
+    put_bit(1);
+    count -= 1<<J[run_index];
+    if(run_index < 31) run_index++;
+  }
+  if(x == width) {
+    if(count > 0) put_bit(1);
+    return x;
+  }
+  put_bit(0);
+  if(J[run_index]) put_bits(count, J[run_index]);
+  encode_run_interruption(cur_row[x], runval, prev_row[x]);
+  if(run_index > 0) run_index--;
+  return x + 1;
+}
+
+static int decode_run(int x) {
+  int runval = cur_row[x-1];
+  int count;
+  for(;;) {
+    if(get_bit()) {
+      count = 1<<J[run_index];
+      if(count > width - x) {
+	/* Carrera hasta el final de la fila. */
+	count = width - x;
+	while(count--) cur_row[x++] = runval;
+	return x;
+      }
+      while(count--) cur_row[x++] = runval;
+      if(run_index < 31) run_index++;
+      if(x == width) return x;
+    } else {
+      count = J[run_index] ? get_bits(J[run_index]) : 0;
+      while(count--) cur_row[x++] = runval;
+      cur_row[x] = decode_run_interruption(cur_row[x-1], prev_row[x]);
+      if(run_index > 0) run_index--;
+      return x + 1;
+    }
+  }
+}
+
+/* Lee un entero de la cabecera PGM, saltando espacios y
+   comentarios. */
+static int read_pgm_int() {
+  int c, n = 0;
+  do {
+    c = getchar();
+    if(c == '#')
+      while(c != '\n' && c != EOF) c = getchar();
+  } while(c == ' ' || c == '\t' || c == '\n' || c == '\r');
+  if(c < '0' || c > '9') {
+    fprintf(stderr, "loco_i: cabecera PGM incorrecta\n");
+    exit(1);
+  }
+  while(c >= '0' && c <= '9') {
+    n = n*10 + c - '0';
+    c = getchar();
+  }
+  return n;
+}
+
+/* Lee una fila de muestras (de 1 o 2 bytes, big-endian). */
+static void read_row(int *row) {
+  int x, c;
+  for(x=0; x<width; x++) {
+    c = getchar();
+    if(maxval > 255) c = (c<<8) | getchar();
+    if(c < 0 || c > maxval) {
+      fprintf(stderr, "loco_i: imagen truncada o muestra fuera de rango\n");
+      exit(1);
+    }
+    row[x] = c;
+  }
+}
+
+static void write_row(int *row) {
+  int x;
+  for(x=0; x<width; x++) {
+    if(maxval > 255) putchar(row[x] >> 8);
+    putchar(row[x] & 0xFF);
+  }
+}
+
+/* Comprime una imagen PGM (P5). */
+void encode_stream(int argc, char *argv[]) {
+  int x, y, q, sign;
+  int a, b, c, d;
+  if(getchar() != 'P' || getchar() != '5') {
+    fprintf(stderr, "loco_i: la entrada no es una imagen PGM (P5)\n");
+    exit(1);
+  }
+  width = read_pgm_int();
+  height = read_pgm_int();
+  maxval = read_pgm_int();
+  if(width < 1 || height < 1 || maxval < 1 || maxval > 65535) {
+    fprintf(stderr, "loco_i: dimensiones o profundidad no soportadas\n");
+    exit(1);
+  }
+  put_bits(width, 32);
+  put_bits(height, 32);
+  put_bits(maxval, 16);
+  init_parameters();
+  init_contexts();
+  init_rows();
+  for(y=0; y<height; y++) {
+    read_row(cur_row);
+    for(x=0; x<width; ) {
+      a = cur_row[x-1];
+      b = prev_row[x];
+      c = prev_row[x-1];
+      d = prev_row[x+1];
+      q = context(d, b, c, a, &sign);
+      if(q == 0)
+	x = encode_run(x);
+      else {
+	encode_regular(q, sign, cur_row[x], a, b, c);
+	x++;
+      }
+    }
+    next_row();
+  }
+  flush();
+  free_rows();
+}
+
+/* Descomprime una imagen y la escribe en formato PGM. */
+void decode_stream(int argc, char *argv[]) {
+  int x, y, q, sign;
+  int a, b, c, d;
+  width = get_bits(32);
+  height = get_bits(32);
+  maxval = get_bits(16);
+  if(width < 1 || height < 1 || maxval < 1) {
+    fprintf(stderr, "loco_i: code-stream incorrecto\n");
+    exit(1);
+  }
+  printf("P5\n%d %d\n%d\n", width, height, maxval);
+  init_parameters();
+  init_contexts();
+  init_rows();
+  for(y=0; y<height; y++) {
+    for(x=0; x<width; ) {
+      a = cur_row[x-1];
+      b = prev_row[x];
+      c = prev_row[x-1];
+      d = prev_row[x+1];
+      q = context(d, b, c, a, &sign);
+      if(q == 0)
+	x = decode_run(x);
+      else {
+	cur_row[x] = decode_regular(q, sign, a, b, c);
+	x++;
+      }
+    }
+    write_row(cur_row);
+    next_row();
+  }
+  free_rows();
+}
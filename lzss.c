@@ -15,48 +15,105 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "bitio.h"
+#include "canonical.h"
+#include "suffix_array.h"
+#include "dictionary.h"
+
+/*
+ * Uso:
+ *
+ * lzss e [-w bits_indice] [-l bits_longitud] [-1 ... -9]
+ *        [-m greedy|lazy|optimal] [-b|-e] [-s [hilos] | -p [hilos]]
+ *        [-D diccionario] [-r] [-f] < entrada > salida
+ * lzss d [-D diccionario] [-r] [-f] < entrada > salida
+ *
+ * "-1" ... "-8" seleccionan los niveles rpidos, que buscan las
+ * cadenas con cadenas hash, y "-9" (por defecto) el rbol binario.
+ * "-m" selecciona el parsing: voraz (por defecto), "lazy" u ptimo.
+ * "-b" selecciona un formato alineado a bytes (por defecto con
+ * ventana de 16 bits y look-ahead de 8 bits), ms rpido de
+ * descomprimir y algo menos compacto. "-e" selecciona un formato en el
+ * que los smbolos, las longitudes y las distancias se codifican con
+ * cdigos de Huffman (con los mismos tamaos por defecto que "-b"),
+ * ms compacto. "-s" busca las cadenas con
+ * arrays de sufijos, por bloques y en paralelo (por defecto, con un
+ * hilo por procesador), en lugar de con el rbol o las cadenas hash.
+ * "-p" reparte la entrada en trozos entre varios hilos (por defecto,
+ * uno por procesador), que buscan las cadenas con el rbol o las
+ * cadenas hash. Slo se paraleliza la bsqueda de cadenas: el stream
+ * es el mismo que sin "-s" ni "-p" y no registra los lmites de los
+ * trozos, as que el descompresor no se reparte entre hilos.
+ * "-D" coloca en la ventana, antes de la entrada, un diccionario
+ * predefinido (ver dict_train.c), y "-r" comprime cada lnea de la
+ * entrada (registro) como un stream independiente que comienza con
+ * la ventana en ese estado. "-f" termina cada lnea (mensaje) con un
+ * punto de sincronizacin, que entrega al descompresor todo lo
+ * comprimido hasta ah sin reiniciar la ventana; en el descompresor,
+ * "-f" evita que lea por adelantado, para que pueda escribir cada
+ * mensaje en cuanto lo recibe. "-f" no se combina con "-r" (que ya
+ * entrega cada registro entero) ni con "-s" o "-p": pedirlo es un
+ * error.
+ *
+ * Los tamaos de la ventana y del look-ahead buffer se eligen al
+ * codificar y viajan en una cabecera, por lo que el descompresor slo
+ * necesita la opcin "-D" (si se us al comprimir). Con los valores
+ * por defecto (12 y 4 bits) y sin "-D" ni "-r" no se escribe cabecera
+ * y el stream es el del formato clsico. La cabecera indica el modo
+ * registro y, con "-D", lleva adems una suma de comprobacin del
+ * diccionario: el descompresor se niega a continuar si le falta o no
+ * es el mismo.
+ */
 
 /*
  * Tamao del cdigo que indican la posicin de la cadena en el
  * diccionario. Determina el tamao la ventana que contiene el texto
  * que se ha codificado anteriormente (diccionario) el y texto que va
- * a codificarse (look-ahead buffer).
+ * a codificarse (look-ahead buffer). Puede llegar a MAX_INDEX_SIZE
+ * bits (una ventana de 16 MiB).
  */
 #define INDEX_SIZE 12
-#define WINDOW_SIZE (1<<INDEX_SIZE)
+#define MAX_INDEX_SIZE 24
+int index_size = INDEX_SIZE;
+int window_size;
 
 /* 
  * Tamao del cdigo que indica la longitud de la cadena
- * encontrada. Determina el tamao del look-ahead buffer.
+ * encontrada. Determina el tamao del look-ahead buffer, que ha de
+ * ser menor que la ventana.
  */
 #define LENGTH_SIZE 4
-#define RAW_LOOK_AHEAD_SIZE (1<<LENGTH_SIZE)
+#define MAX_LENGTH_SIZE 16
+int length_size = LENGTH_SIZE;
+int raw_look_ahead_size;
 
 /*
  * Tamao mnimo de la cadena a codificar, medido en bytes. Se utiliza
  * para decidir si se envan cdigos ijk o slo smbolos
- * k. Tpicamente MIN_ENCODED_STRING_SIZE valdr 1, lo que signfica
+ * k. Tpicamente min_encoded_string_size valdr 1, lo que signfica
  * que slo si concatenamos al menos 2 smbolos utilizaremos un cdigo
- * ijk.
+ * ijk. Vale (1 + index_size + length_size)/9.
  */
-#define MIN_ENCODED_STRING_SIZE ((1 +INDEX_SIZE+LENGTH_SIZE)/9)
+int min_encoded_string_size;
 
 /*
  * Tamao efectivo del look-ahead buffer. Puesto que en la prctica no
  * van a codificase cadenas de menos de 2 smbolos, es posible
  * reajustar el tamao del look-ahead buffer sumndole 2. De esta
- * manera, cuando envimos un cdigo ijk donde j=0, en realidad
+ * manera, cuando envimos un cdigo ijk donde j=0, en realidad
  * estaremos indicando una longitud real de 2. Ntese que esto tambin
  * provoca que el tamao real del look-ahead buffer sea de 17 smbolos
- * cuando RAW_LOOK_AHEAD_BUFFER == 16.
+ * cuando raw_look_ahead_size == 16.
 */
-#define LOOK_AHEAD_SIZE (RAW_LOOK_AHEAD_SIZE + MIN_ENCODED_STRING_SIZE)
+int look_ahead_size;
 
 /*
- * Indice del nodo que apunta a la raz del rbol binario.
+ * Indice del nodo que apunta a la raz del rbol binario
+ * (window_size).
  */
-#define TREE_ROOT WINDOW_SIZE
+int tree_root;
 
 /*
  * Cdigo de compresin que indica el fin del stream de datos.
@@ -70,18 +127,20 @@
 #define UNUSED 0
 
 /*
- * Calcula el mdulo del entero "a" usando INDEX_SIZE bits de
+ * Calcula el mdulo del entero "a" usando index_size bits de
  * precisin.
  */
-#define MOD_WINDOW(a) ((a) & (WINDOW_SIZE-1))
+#define MOD_WINDOW(a) ((a) & (window_size-1))
 
 /*
  * Diccionario y look-ahead buffer. Cuando comparemos la cadena que
  * almacena el look-ahead buffer con la que est en la posicin "p"
  * del diccionario, estaremos comparando dicha cadena con la que
- * comienza a partir de dicha direccin "p".
+ * comienza a partir de dicha direccin "p". Tiene window_size bytes.
+ * Como el resto del estado del buscador de cadenas, es local a cada
+ * hilo (__thread), ya que con "-p" cada hilo tiene su propia ventana.
  */
-unsigned char window[WINDOW_SIZE];
+__thread unsigned char *window;
 
 /*
  * Arbol binario de todas las cadenas que hay en la ventana ordenadas
@@ -91,7 +150,7 @@ unsigned char window[WINDOW_SIZE];
  * "smaller_child" es menor que la cadena a la que apunta "parent" y
  * menos que la cadena a la que apunta "larger_child".
  *
- * Por motivos de eficiencia de clculo, tree[WINDOW_SIZE] es un nodo
+ * Por motivos de eficiencia de clculo, tree[window_size] es un nodo
  * especial que se utiliza para localizar la raz del rbol. Este
  * elemento no apunta a ninguna frase (como hacen el resto de nodos
  * del rbol) Este nodo representa adems al cdigo END_OF_STREAM.
@@ -142,12 +201,425 @@ unsigned char window[WINDOW_SIZE];
  *                        |       |
  *                      nodo 10
  *                    "baaaaaaa"
+ *
+ * El rbol tiene window_size + 1 nodos.
  */
-struct {
+struct node {
   int parent;
   int smaller_child;
   int larger_child;
-} tree[WINDOW_SIZE + 1];
+};
+__thread struct node *tree;
+
+/*
+ * Nivel de compresin ("-1" ... "-9"). Los niveles 1 a 8 buscan las
+ * cadenas con cadenas hash (rpido) y el nivel TREE_LEVEL, que es el
+ * nivel por defecto, con el rbol binario (exhaustivo). En las
+ * cadenas hash, "max_chain" es el nmero mximo de candidatos que se
+ * comparan y "nice_length" la longitud de una cadena que se da por
+ * suficientemente buena como para dejar de buscar (como mucho, el
+ * look-ahead buffer). Tanto en las cadenas hash como en el rbol,
+ * "nice_length" es adems la longitud hasta la que se comparan las
+ * cadenas: con look-ahead buffers grandes, comparar el buffer entero
+ * con cada candidato hace que cada bsqueda cueste tanto como el
+ * buffer en cuanto la entrada se repite. La cadena elegida se alarga
+ * despus con extend_match().
+ */
+#define TREE_LEVEL 9
+int level = TREE_LEVEL;
+struct {
+  int max_chain;
+  int nice_length;
+} levels[TREE_LEVEL + 1] = {
+  {    0,   0 },
+  {    1,  16 },
+  {    4,  32 },
+  {    8,  64 },
+  {   16, 128 },
+  {   32, 128 },
+  {   64, 192 },
+  {  128, 256 },
+  {  256, 256 },
+  {    0, 256 }
+};
+
+/*
+ * levels[level].nice_length, limitada al look-ahead buffer.
+ */
+int nice_length;
+
+/*
+ * Cadenas hash. "head[h]" es la ltima posicin insertada cuyos
+ * HASH_STRING_SIZE primeros smbolos tienen el hash "h", y
+ * "chain[MOD_WINDOW(p)]" la posicin anterior a "p" con el mismo
+ * hash. Las posiciones son absolutas (no se reducen mdulo la
+ * ventana) para poder descartar las que ya han salido del
+ * diccionario. La posicin absoluta 0 indica el final de la cadena.
+ */
+#define HASH_BITS 16
+#define HASH_SIZE (1<<HASH_BITS)
+#define HASH_STRING_SIZE 3
+__thread unsigned int *head;
+__thread unsigned int *chain;
+__thread unsigned int hash_position;
+
+/*
+ * Estrategia de parsing ("-m"). GREEDY toma siempre la cadena ms
+ * larga, LAZY la retrasa un smbolo si en la siguiente posicin se
+ * encuentra una ms larga y OPTIMAL elige, en bloques de
+ * PARSE_BLOCK_SIZE posiciones, la secuencia de cdigos que ocupa
+ * menos bits.
+ */
+#define GREEDY 0
+#define LAZY 1
+#define OPTIMAL 2
+int parsing = GREEDY;
+
+/*
+ * Formato del code-stream. BIT_FORMAT es el formato clsico, con los
+ * cdigos empaquetados bit a bit. En BYTE_FORMAT ("-b") todos los
+ * campos ocupan bytes completos (ver put_byte_token()), para que el
+ * descompresor no tenga que trabajar a nivel de bit. Los cdigos
+ * "ij" de BYTE_FORMAT indican la distancia a la cadena, en
+ * "offset_bytes" bytes. "min_match_length" es la longitud mnima de
+ * las cadenas que se codifican en todos los formatos. En
+ * ENTROPY_FORMAT ("-e") los cdigos se codifican con cdigos de
+ * Huffman (ver flush_entropy_block()).
+ */
+#define BIT_FORMAT 0
+#define BYTE_FORMAT 1
+#define ENTROPY_FORMAT 2
+#define BYTE_INDEX_SIZE 16
+#define BYTE_LENGTH_SIZE 8
+int format = BIT_FORMAT;
+int offset_bytes;
+int min_match_length;
+
+/*
+ * Bsqueda de cadenas con arrays de sufijos ("-s"). La entrada se
+ * divide en bloques de "sa_block_size" smbolos y, para cada bloque,
+ * se construye el array de sufijos del bloque precedido de los
+ * "sa_history_size" smbolos anteriores, del que se obtiene de una
+ * vez la cadena ms larga de cada posicin (ver
+ * longest_previous_factor()). Como sa_history_size + sa_block_size
+ * no supera window_size - look_ahead_size, todas las cadenas
+ * encontradas estn en el diccionario. Cada uno de los "chunk_threads"
+ * hilos (0 si no se usan "-s" ni "-p") procesa un trozo de
+ * SA_CHUNK_SIZE smbolos (como mnimo un bloque), y los bloques estn
+ * limitados a SA_BLOCK_SIZE smbolos, por lo que la memoria no
+ * depende del tamao de la entrada.
+ *
+ * Con "-p" los trozos se procesan igual, pero cada hilo busca las
+ * cadenas con el rbol binario o las cadenas hash, en su propia
+ * ventana, que se carga primero con los window_size - look_ahead_size
+ * smbolos anteriores al trozo ("sa_history_size"). As las cadenas
+ * pueden cruzar los lmites de los trozos y el resultado es casi el
+ * mismo que sin "-p". Los trozos son de al menos 4 ventanas, para que
+ * la carga de la ventana no domine.
+ *
+ * Los lmites de los trozos no se escriben en el stream. Como las
+ * cadenas de un trozo pueden copiar smbolos del anterior, el
+ * descompresor tendra que esperar al trozo anterior de todas formas
+ * (o reescribir despus las cadenas afectadas), y la copia de cadenas
+ * ya es lo que limita su velocidad; trozos independientes, en cambio,
+ * empeoraran la compresin.
+ */
+#define SA_BLOCK_SIZE (1<<20)
+#define SA_CHUNK_SIZE (1<<20)
+#define MAX_THREADS 64
+int chunk_threads = 0;
+int suffix_arrays = 0;
+int sa_block_size;
+int sa_history_size;
+
+/*
+ * Diccionario predefinido ("-D") y modo registro ("-r"). Los
+ * "preset_size" ltimos bytes del diccionario (como mucho
+ * window_size/2, para que quede sitio para los datos) ocupan las
+ * posiciones de la ventana anteriores a la 1, en la que comienza la
+ * entrada, como si se hubieran codificado antes que ella. En modo
+ * registro cada registro comienza con la ventana en ese estado, y el
+ * buscador de cadenas no se reconstruye: el rbol binario restaura
+ * una copia de los nodos del diccionario ("preset_tree") y libera los
+ * del registro, y en las cadenas hash basta con cambiar de
+ * "generation", ya que head[h] slo es vlido si head_generation[h]
+ * es la generacin actual (si no, vale preset_head[h]). Slo si un
+ * registro no cabe en la ventana sin pisar el diccionario se
+ * restauran tambin la ventana y las cadenas del diccionario.
+ */
+char *dictionary_name = NULL;
+int records = 0;
+unsigned char *preset;
+int preset_size = 0;
+unsigned int preset_checksum;
+struct node *preset_tree;
+unsigned int *preset_head;
+unsigned int *preset_chain;
+__thread unsigned int *head_generation;
+unsigned int generation;
+
+/*
+ * Registro actual (en modo registro): una lnea de la entrada,
+ * incluido su '\n'. Los hilos de "-p" leen su trozo de la misma
+ * forma.
+ */
+__thread unsigned char *record;
+__thread int record_size = 0;
+__thread int record_length = 0;
+__thread int record_position = 0;
+
+/*
+ * Puntos de sincronizacin ("-f"). Cada mensaje (una lnea de la
+ * entrada, como los registros) termina con un END_OF_STREAM seguido
+ * de un 1 (la longitud en BIT_FORMAT y BYTE_FORMAT, y un tercer
+ * entero en ENTROPY_FORMAT) y el code-stream contina en el siguiente
+ * byte. Al final del stream ese valor es 0 (o no est, y se leen los
+ * ceros de relleno). En ENTROPY_FORMAT cada mensaje cierra un bloque,
+ * con sus propios cdigos, as que con mensajes cortos "-f" sale ms
+ * caro que en los otros formatos. "synced" indica que el siguiente
+ * mensaje contina la ventana del anterior, y "sync_nodes" guarda los
+ * nodos que suspend_window() ha sacado del rbol.
+ */
+int sync_flush = 0;
+int synced = 0;
+int *sync_nodes;
+int sync_node_count;
+
+/*
+ * Reserva la ventana y el buscador de cadenas (del hilo que llama).
+ */
+void alloc_finder() {
+  window = (unsigned char *)calloc(window_size, 1);
+  if(level == TREE_LEVEL)
+    tree = (struct node *)calloc(window_size + 1, sizeof(struct node));
+  else {
+    head = (unsigned int *)calloc(HASH_SIZE, sizeof(unsigned int));
+    chain = (unsigned int *)calloc(window_size, sizeof(unsigned int));
+  }
+  if(!window || (level == TREE_LEVEL ? !tree : (!head || !chain))) {
+    fprintf(stderr,"lzss: memoria insuficiente\n");
+    exit(1);
+  }
+}
+
+/*
+ * Calcula los tamaos que dependen de index_size y length_size y, si
+ * se va a comprimir, reserva la ventana y el buscador de cadenas.
+ */
+void init_window(int encoding) {
+  window_size = 1 << index_size;
+  raw_look_ahead_size = 1 << length_size;
+  min_encoded_string_size = (1 + index_size + length_size)/9;
+  look_ahead_size = raw_look_ahead_size + min_encoded_string_size;
+  tree_root = window_size;
+  if(format == BYTE_FORMAT) {
+    offset_bytes = index_size <= 16 ? 2 : 3;
+    /* Un cdigo "ij" ocupa al menos offset_bytes + 1 bytes. */
+    min_match_length = offset_bytes + 2;
+  } else
+    min_match_length = min_encoded_string_size + 1;
+  nice_length = levels[ level ].nice_length;
+  if(nice_length == 0 || nice_length > look_ahead_size)
+    nice_length = look_ahead_size;
+  if(encoding && !chunk_threads)
+    alloc_finder();
+}
+
+/*
+ * Comprueba que la ventana y el look-ahead buffer tienen tamaos
+ * vlidos.
+ */
+void check_sizes() {
+  if(index_size<2 || index_size>MAX_INDEX_SIZE ||
+     length_size<1 || length_size>MAX_LENGTH_SIZE ||
+     (1<<length_size) + (1+index_size+length_size)/9 >= (1<<index_size)) {
+    fprintf(stderr,"lzss: tamaos incorrectos (-w %d -l %d)\n",
+	    index_size, length_size);
+    exit(1);
+  }
+}
+
+/*
+ * Lee las opciones "-w" y "-l" del compresor.
+ */
+void parse_options(int argc, char *argv[]) {
+  int i;
+  int w = -1, l = -1;
+  for(i=2; i<argc; i++) {
+    if(strcmp(argv[i],"-w")==0 && i+1<argc)
+      w = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-l")==0 && i+1<argc)
+      l = atoi(argv[++i]);
+    else if(strcmp(argv[i],"-b")==0)
+      format = BYTE_FORMAT;
+    else if(strcmp(argv[i],"-e")==0)
+      format = ENTROPY_FORMAT;
+    else if(strcmp(argv[i],"-s")==0 || strcmp(argv[i],"-p")==0) {
+      if(argv[i][1]=='s')
+	suffix_arrays = 1;
+      if(i+1<argc && isdigit(argv[i+1][0]))
+	chunk_threads = atoi(argv[++i]);
+      else
+	chunk_threads = sysconf(_SC_NPROCESSORS_ONLN);
+      if(chunk_threads < 1)
+	chunk_threads = 1;
+      if(chunk_threads > MAX_THREADS)
+	chunk_threads = MAX_THREADS;
+    }
+    else if(strcmp(argv[i],"-D")==0 && i+1<argc)
+      dictionary_name = argv[++i];
+    else if(strcmp(argv[i],"-r")==0)
+      records = 1;
+    else if(strcmp(argv[i],"-f")==0)
+      sync_flush = 1;
+    else if(argv[i][0]=='-' && isdigit(argv[i][1]) && !argv[i][2])
+      level = argv[i][1] - '0';
+    else if(strcmp(argv[i],"-m")==0 && i+1<argc) {
+      i++;
+      if(strcmp(argv[i],"greedy")==0) parsing = GREEDY;
+      else if(strcmp(argv[i],"lazy")==0) parsing = LAZY;
+      else if(strcmp(argv[i],"optimal")==0) parsing = OPTIMAL;
+      else {
+	fprintf(stderr,"lzss: parsing desconocido: %s\n", argv[i]);
+	exit(1);
+      }
+    }
+  }
+  if(level<1 || level>TREE_LEVEL) {
+    fprintf(stderr,"lzss: nivel incorrecto (-%d)\n", level);
+    exit(1);
+  }
+  if(sync_flush && (records || chunk_threads)) {
+    fprintf(stderr,"lzss: \"-f\" no se combina con \"-r\", \"-s\" ni \"-p\"\n");
+    exit(1);
+  }
+  /* Por defecto, BYTE_FORMAT y ENTROPY_FORMAT usan una ventana y
+     cadenas ms grandes. */
+  if(format != BIT_FORMAT) {
+    index_size = BYTE_INDEX_SIZE;
+    length_size = BYTE_LENGTH_SIZE;
+  }
+  if(w >= 0) index_size = w;
+  if(l >= 0) length_size = l;
+  check_sizes();
+}
+
+/*
+ * Lee las opciones "-D", "-r" y "-f" del descompresor.
+ */
+void parse_decoder_options(int argc, char *argv[]) {
+  int i;
+  for(i=2; i<argc; i++) {
+    if(strcmp(argv[i],"-D")==0 && i+1<argc)
+      dictionary_name = argv[++i];
+    else if(strcmp(argv[i],"-r")==0)
+      records = 1;
+    else if(strcmp(argv[i],"-f")==0)
+      sync_flush = 1;
+  }
+  if(sync_flush && records) {
+    fprintf(stderr,"lzss: \"-f\" no se combina con \"-r\"\n");
+    exit(1);
+  }
+}
+
+/*
+ * Lee el diccionario predefinido (si se ha indicado uno) y se queda
+ * con sus preset_size ltimos bytes.
+ */
+void load_preset() {
+  int size;
+  if(!dictionary_name)
+    return;
+  preset = read_dictionary(dictionary_name, &size);
+  preset_checksum = dictionary_checksum(preset, size);
+  preset_size = size < window_size/2 ? size : window_size/2;
+  preset += size - preset_size;
+}
+
+/*
+ * Lee el siguiente registro. Devuelve su longitud (0 al final de la
+ * entrada).
+ */
+int read_record() {
+  int c;
+  record_length = record_position = 0;
+  while((c = getchar()) != EOF) {
+    if(record_length == record_size) {
+      record_size = record_size ? 2*record_size : 4096;
+      record = (unsigned char *)realloc(record, record_size);
+      if(!record) {
+	fprintf(stderr,"lzss: memoria insuficiente\n");
+	exit(1);
+      }
+    }
+    record[record_length++] = (unsigned char)c;
+    if(c == '\n')
+      break;
+  }
+  return record_length;
+}
+
+/*
+ * Entrada del compresor: el registro actual en modo registro (o el
+ * trozo de un hilo de "-p") y, si no, la entrada estndar.
+ */
+int next_symbol() {
+  if(!record)
+    return getchar();
+  if(record_position == record_length)
+    return EOF;
+  return record[record_position++];
+}
+
+int read_symbols(unsigned char *dst, int n) {
+  if(!records)
+    return fread(dst, 1, n, stdin);
+  if(n > record_length - record_position)
+    n = record_length - record_position;
+  memcpy(dst, record + record_position, n);
+  record_position += n;
+  return n;
+}
+
+/*
+ * La cabecera es un bit 0 seguido de index_size (6 bits) y
+ * length_size (6 bits). Un stream clsico nunca comienza as: su
+ * primer cdigo es un smbolo "k" (bit 1) o END_OF_STREAM (bit 0
+ * seguido de 12 bits a 0). Como index_size < 32, el bit ms
+ * significativo de su campo (HEADER_PRESET) indica si se ha usado un
+ * diccionario predefinido, y en ese caso la cabecera termina con su
+ * resumen (32 bits, ver dictionary_checksum()). Del mismo modo, como
+ * length_size < 32, el bit ms significativo del suyo
+ * (HEADER_RECORDS) indica el modo registro. La lee decode_stream(),
+ * que comprueba que el descompresor tiene el mismo diccionario.
+ */
+#define HEADER_SIZE 13
+#define HEADER_PRESET (1 << 11)
+#define HEADER_RECORDS (1 << 5)
+void write_header() {
+  put_bit(0);
+  put_bits((dictionary_name ? HEADER_PRESET : 0) |
+	   (records ? HEADER_RECORDS : 0) |
+	   (index_size<<6) | length_size, HEADER_SIZE - 1);
+  if(dictionary_name) {
+    put_bits(preset_checksum >> 16, 16);
+    put_bits(preset_checksum & 0xFFFF, 16);
+  }
+}
+
+/*
+ * En BYTE_FORMAT y ENTROPY_FORMAT, el segundo byte de la cabecera
+ * lleva BYTE_HEADER_PRESET si se ha usado un diccionario predefinido
+ * y BYTE_HEADER_RECORDS en modo registro (sigue siendo una cabecera
+ * imposible en BIT_FORMAT). Con diccionario, la cabecera termina con
+ * su resumen (4 bytes, little-endian).
+ */
+#define BYTE_HEADER_PRESET 0x01
+#define BYTE_HEADER_RECORDS 0x02
+#define BYTE_HEADER_FLAGS \
+  ((dictionary_name ? BYTE_HEADER_PRESET : 0) | \
+   (records ? BYTE_HEADER_RECORDS : 0))
 
 /*
  * Inicializa el rbol con el diccionario vaco.
@@ -162,8 +634,8 @@ struct {
  *        0         0
  */
 void InitTree(int r) {
-  tree[ TREE_ROOT ].larger_child = r;
-  tree[ r ].parent = TREE_ROOT;
+  tree[ tree_root ].larger_child = r;
+  tree[ r ].parent = tree_root;
   tree[ r ].larger_child = UNUSED;
   tree[ r ].smaller_child = UNUSED;
 }
@@ -277,7 +749,10 @@ void DeleteString(int p) {
 
 /*
  * Esta rutina inserta un nuevo nodo al rbol binario y encuentra
- * (retornando) la mejor ocurrencia de la cadena buscada.
+ * (retornando) la mejor ocurrencia de la cadena buscada. Las cadenas
+ * slo se comparan hasta nice_length smbolos, as que el rbol
+ * las ordena por ese prefijo y una cadena de nice_length smbolos
+ * o ms no se ha comparado entera.
  */
 int AddString(int new_node, int *match_position) {
   int i;
@@ -291,12 +766,12 @@ int AddString(int new_node, int *match_position) {
     return 0;
   /* Accedemos a la raz del rbol y de ah al primer nodo con datos
      almacenado. */
-  test_node = tree[ TREE_ROOT ].larger_child;
+  test_node = tree[ tree_root ].larger_child;
   /* La longitud de la cadena encontrada es todava, 0. */
   match_length = 0;
   for ( ; ; ) {
     /* "i" contiene el "match_length" actual. */
-    for ( i = 0 ; i < LOOK_AHEAD_SIZE ; i++ ) {
+    for ( i = 0 ; i < nice_length ; i++ ) {
       /* "delta" < 1 si la cadena almacenada en "new_node" es menor
 	 que la de "test_node", "delta" = 0 si son iguales y "delta" >
 	 1 si la cadena en "nee_node" es mayor que la de
@@ -310,10 +785,9 @@ int AddString(int new_node, int *match_position) {
     if ( i >= match_length ) {
       match_length = i;
       *match_position = test_node;
-      /* Si hemos encontrado todo el buffer de anticipacin en el
-	 diccionario (ya no es posible buscar una cadena ms
-	 larga). */
-      if ( match_length >= LOOK_AHEAD_SIZE ) {
+      /* Si hemos encontrado el prefijo entero en el diccionario (el
+	 rbol no distingue cadenas ms largas). */
+      if ( match_length >= nice_length ) {
 	/* "new_node" reemplaza a "test_node" para manterner el rbol
 	   lo ms pequeo posible, sin afectar a la tasa de
 	   compresin. */
@@ -338,117 +812,2046 @@ int AddString(int new_node, int *match_position) {
 }
 
 /*
- * Realiza la compresin del stream.
+ * Hash de los HASH_STRING_SIZE smbolos que comienzan en la
+ * posicin "p" de la ventana.
  */
-void encode_stream(int argc, char *argv[]) {
+#define HASH(p) \
+  ((((unsigned int)window[ p ] << 16 | \
+     (unsigned int)window[ MOD_WINDOW( (p) + 1 ) ] << 8 | \
+     (unsigned int)window[ MOD_WINDOW( (p) + 2 ) ]) * 2654435761U) \
+   >> (32 - HASH_BITS))
+
+/*
+ * Equivalente a InitTree() para las cadenas hash. "r" es la posicin
+ * absoluta (y en la ventana) de la primera cadena.
+ */
+void InitHash(int r) {
+  hash_position = r;
+  head[ HASH( r ) ] = r;
+  chain[ r ] = 0;
+}
+
+/*
+ * Inserta en las cadenas hash la cadena que comienza en "new_node",
+ * que ha de ser la siguiente a la ltima insertada, sin buscar en
+ * ellas. Retorna el primer candidato (0 si no hay ninguno). Las
+ * posiciones que el parsing salta slo se insertan.
+ */
+unsigned int InsertHashString(int new_node) {
+  unsigned int candidate;
+  int h;
+
+  hash_position++;
+  /* Como en AddString(), la posicin 0 de la ventana nunca se
+     inserta, puesto que su ndice representa a END_OF_STREAM. */
+  if ( new_node == END_OF_STREAM )
+    return 0;
+  h = HASH( new_node );
+  candidate = head[ h ];
+  if ( head_generation && head_generation[ h ] != generation ) {
+    /* "head[h]" es de un registro anterior. */
+    candidate = preset_head[ h ];
+    head_generation[ h ] = generation;
+  }
+  head[ h ] = hash_position;
+  chain[ new_node ] = candidate;
+  return candidate;
+}
+
+/*
+ * Equivalente a AddString() para las cadenas hash. Inserta la cadena
+ * que comienza en "new_node" y retorna la longitud de la cadena ms
+ * larga encontrada entre los primeros levels[level].max_chain
+ * candidatos, comparando como mucho nice_length smbolos. No es
+ * necesario borrar las cadenas que salen del diccionario: slo se
+ * aceptan los candidatos que estn a menos de window_size -
+ * look_ahead_size posiciones, que son los que AddString() tendra en
+ * el rbol.
+ */
+int AddHashString(int new_node, int *match_position) {
+  unsigned int candidate;
+  unsigned int next;
+  unsigned int limit;
   int i;
-  int c;
-  int look_ahead_bytes;
-  int current_position;
-  int replace_count;
+  int p;
   int match_length;
-  int match_position;
+  int chain_length;
 
-  /* Carga el buffer de anticipacin. */
-  current_position = 1;
-  for ( i = 0 ; i < LOOK_AHEAD_SIZE ; i++ ) {
-    if ( ( c = getchar() ) == EOF )
+  candidate = InsertHashString( new_node );
+  limit = window_size - look_ahead_size;
+  match_length = 0;
+  for ( chain_length = levels[ level ].max_chain ;
+	chain_length > 0 && candidate != 0 &&
+	  hash_position - candidate < limit ;
+	chain_length-- ) {
+    p = MOD_WINDOW( candidate );
+    /* Slo se compara la cadena entera si puede ser ms larga que la
+       mejor encontrada. */
+    if ( window[ MOD_WINDOW( p + match_length ) ] ==
+	 window[ MOD_WINDOW( new_node + match_length ) ] ) {
+      for ( i = 0 ; i < nice_length ; i++ )
+	if ( window[ MOD_WINDOW( new_node + i ) ] !=
+	     window[ MOD_WINDOW( p + i ) ] )
+	  break;
+      if ( i > match_length ) {
+	match_length = i;
+	*match_position = p;
+	if ( match_length >= nice_length )
+	  break;
+      }
+    }
+    next = chain[ p ];
+    if ( next >= candidate )
       break;
-    window[ current_position + i ] = (unsigned char) c;
+    candidate = next;
   }
-  look_ahead_bytes = i; /* look_ahead_bytes = 17, excepto al final de
-			   la compresin. */
+  return match_length;
+}
 
-  /* Inicializa el rbol de bsqueda binario. */
-  InitTree( current_position );
+/*
+ * Estado del compresor: posicin actual en la ventana, nmero de
+ * smbolos que quedan en el look-ahead buffer y cadena encontrada
+ * para la posicin actual.
+ */
+__thread int current_position;
+__thread int look_ahead_bytes;
+__thread int match_length;
+__thread int match_position;
 
-  /* Longitud de la cadena encontrada. */
-  match_length = 0;
+/*
+ * Si la bsqueda se detuvo en nice_length smbolos, alarga la cadena
+ * encontrada para la posicin actual hasta donde llegue (como mucho,
+ * el look-ahead buffer). Slo se hace con la cadena que se va a
+ * usar, no con las de las posiciones que se saltan. Si la posicin
+ * anterior se alarg con la misma distancia, su cadena sin el primer
+ * smbolo ya es conocida, y no se vuelve a comparar (el parsing
+ * ptimo busca en todas las posiciones de una repeticin).
+ */
+__thread int extended_position;
+__thread int extended_distance;
+__thread int extended_length;
 
-  /* Posicin de la cadena encontrada. */
-  match_position = 0;
+void extend_match() {
+  int distance;
 
-  /* Comienza la compresin. */
-  while ( look_ahead_bytes > 0 ) {
-    if ( match_length > look_ahead_bytes )
-      match_length = look_ahead_bytes;
-    /* Decidimos si enviar una "k" o un cdigo "ij". */
-    if ( match_length <= MIN_ENCODED_STRING_SIZE ) {
-      /* "k": Un-encoded output. */
-      put_bit(1);
-      put_bits(window[ current_position ], 8);
-      replace_count = 1;
-    } else {
-      /* "ij": Encoded output. */
-      put_bit(0);
-      put_bits(match_position, INDEX_SIZE);
-      put_bits((match_length - (MIN_ENCODED_STRING_SIZE + 1)),
-	       LENGTH_SIZE );
-      replace_count = match_length;
-    }
-
-    /* Insertamos "replace_count" smbolos en el buffer de
-       anticipacin y los eleiminados del diccionario.*/
-    for ( i = 0 ; i < replace_count ; i++ ) {
-      /* Eliminamos del rbol binario de bsqueda los smbolos que
-	 salen por la parte izquierda de la ventana deslizante. */
-      DeleteString( MOD_WINDOW( current_position + LOOK_AHEAD_SIZE ) );
-      /* Leemos los nuevos smbolos. */
-      if ( ( c = getchar() ) == EOF )
-	look_ahead_bytes--;
-      else
-	window[ MOD_WINDOW( current_position + LOOK_AHEAD_SIZE ) ]
-	  = (unsigned char) c;
-      /* Actualizamos el "puntero" por el que vamos comprimiendo el
-	 stream de datos. No olvidemos que lo procesamos usando una
-	 cola circular. */
-      current_position = MOD_WINDOW( current_position + 1 );
-      /* Insertamos en el rbol binario de bsqueda los nuevos
-	 smbolos. */
-      if ( look_ahead_bytes )
+  if ( match_length < nice_length )
+    return;
+  distance = MOD_WINDOW( current_position - match_position );
+  if ( extended_position == MOD_WINDOW( current_position - 1 ) &&
+       extended_distance == distance && extended_length - 1 > match_length )
+    match_length = extended_length - 1;
+  while ( match_length < look_ahead_size &&
+	  window[ MOD_WINDOW( current_position + match_length ) ] ==
+	  window[ MOD_WINDOW( match_position + match_length ) ] )
+    match_length++;
+  extended_position = current_position;
+  extended_distance = distance;
+  extended_length = match_length;
+}
+
+/*
+ * Desplaza la ventana "count" posiciones. Por cada una, se elimina
+ * del diccionario la cadena ms antigua, se lee un nuevo smbolo y
+ * se inserta la cadena de la nueva posicin. Con las cadenas hash,
+ * slo se busca la de la ltima posicin.
+ */
+void advance(int count) {
+  int i;
+  int c;
+
+  for ( i = 0 ; i < count ; i++ ) {
+    /* Eliminamos del rbol binario de bsqueda los smbolos que
+       salen por la parte izquierda de la ventana deslizante. */
+    if ( level == TREE_LEVEL )
+      DeleteString( MOD_WINDOW( current_position + look_ahead_size ) );
+    /* Leemos los nuevos smbolos. */
+    if ( ( c = next_symbol() ) == EOF )
+      look_ahead_bytes--;
+    else
+      window[ MOD_WINDOW( current_position + look_ahead_size ) ]
+	= (unsigned char) c;
+    /* Actualizamos el "puntero" por el que vamos comprimiendo el
+       stream de datos. No olvidemos que lo procesamos usando una
+       cola circular. */
+    current_position = MOD_WINDOW( current_position + 1 );
+    /* Insertamos en el rbol binario de bsqueda los nuevos
+       smbolos. */
+    if ( look_ahead_bytes ) {
+      if ( level == TREE_LEVEL )
 	match_length = AddString( current_position, &match_position );
+      else if ( i < count - 1 )
+	InsertHashString( current_position );
+      else
+	match_length = AddHashString( current_position, &match_position );
     }
-  };
-  /* EOF alcanzado. */
-  put_bit(0);
-  put_bits(END_OF_STREAM, INDEX_SIZE);
-  flush();
+  }
+  if ( look_ahead_bytes )
+    extend_match();
+  if ( match_length > look_ahead_bytes )
+    match_length = look_ahead_bytes;
 }
 
 /*
- * Realiza la descompresin del stream.
+ * Coloca el diccionario predefinido en la ventana e inserta sus
+ * cadenas en el buscador. En el rbol slo se insertan las que estn
+ * enteras en el diccionario, para que su posicin en el rbol no
+ * dependa de los registros. Las posiciones absolutas del diccionario
+ * en las cadenas hash terminan en window_size, de forma que la
+ * entrada comienza en la posicin absoluta window_size + 1 (la
+ * posicin 1 de la ventana).
  */
-void decode_stream(int argc, char *argv[]) {
+void init_preset() {
+  unsigned int a;
+  int position;
+  int h;
   int i;
-  int current_position;
-  int c;
-  int match_length;
-  int match_position;
-  
-  current_position = 1;
-  for ( ; ; ) {
-    if (get_bit()) {
-      /* Ledo 1, un-encoded "k". */
-      c = get_bits(8);
-      putchar(c);
-      window[ current_position ] = (unsigned char) c;
-      current_position = MOD_WINDOW( current_position + 1 );
-    } else {
-      /* Ledo 0, "ij" code. */
-      match_position = get_bits(INDEX_SIZE); /* "i" */
-      if ( match_position == END_OF_STREAM )
-	break;
-      match_length = get_bits(LENGTH_SIZE); /* "j" */
-      match_length += MIN_ENCODED_STRING_SIZE;
-      /* Copiamos a la salida "j" caracteres a partir de la posicin
-	 "i" del diccionario. */
-      for ( i = 0 ; i <= match_length ; i++ ) {
-	c = window[ MOD_WINDOW( match_position + i ) ];
-	putchar(c);
-	window[ current_position ] = (unsigned char) c;
-	current_position = MOD_WINDOW( current_position + 1 );
+  int p;
+
+  for ( i = 0 ; i < preset_size ; i++ )
+    window[ MOD_WINDOW( 1 - preset_size + i ) ] = preset[ i ];
+  if ( level == TREE_LEVEL ) {
+    for ( i = 0 ; i + look_ahead_size <= preset_size ; i++ ) {
+      p = MOD_WINDOW( 1 - preset_size + i );
+      if ( i == 0 )
+	InitTree( p );
+      else
+	AddString( p, &position );
+    }
+    if ( records ) {
+      preset_tree = (struct node *)malloc(( preset_size + 1 )*
+					   sizeof(struct node));
+      if ( !preset_tree ) {
+	fprintf(stderr,"lzss: memoria insuficiente\n");
+	exit(1);
+      }
+      memcpy(preset_tree, tree + window_size - preset_size,
+	     ( preset_size + 1 )*sizeof(struct node));
+    }
+  } else {
+    for ( i = 0 ; i + HASH_STRING_SIZE <= preset_size ; i++ ) {
+      a = window_size + 1 - preset_size + i;
+      p = MOD_WINDOW( a );
+      h = HASH( p );
+      chain[ p ] = head[ h ];
+      head[ h ] = a;
+    }
+    if ( records ) {
+      preset_head = (unsigned int *)malloc(HASH_SIZE*sizeof(unsigned int));
+      head_generation = (unsigned int *)calloc(HASH_SIZE,
+					       sizeof(unsigned int));
+      preset_chain = (unsigned int *)malloc(( preset_size + 1 )*
+					    sizeof(unsigned int));
+      if ( !preset_head || !head_generation || !preset_chain ) {
+	fprintf(stderr,"lzss: memoria insuficiente\n");
+	exit(1);
+      }
+      memcpy(preset_head, head, HASH_SIZE*sizeof(unsigned int));
+      memcpy(preset_chain, chain + window_size - preset_size,
+	     preset_size*sizeof(unsigned int));
+    }
+  }
+}
+
+/*
+ * Devuelve la ventana y el buscador de cadenas al estado de
+ * init_preset() tras comprimir un registro de "length" smbolos, que
+ * ocup las posiciones 1 a "length" de la ventana (y ley hasta
+ * look_ahead_size posiciones ms).
+ */
+void reset_window(int length) {
+  int overflow;
+  int n;
+  int i;
+
+  overflow = length + look_ahead_size > window_size - preset_size;
+  n = overflow ? window_size - preset_size : length;
+  if ( n > window_size - 1 )
+    n = window_size - 1;
+  if ( level == TREE_LEVEL ) {
+    for ( i = 1 ; i <= n ; i++ )
+      tree[ i ].parent = UNUSED;
+    memcpy(tree + window_size - preset_size, preset_tree,
+	   ( preset_size + 1 )*sizeof(struct node));
+  } else {
+    if ( ++generation == 0 ) {
+      memcpy(head, preset_head, HASH_SIZE*sizeof(unsigned int));
+      memset(head_generation, 0, HASH_SIZE*sizeof(unsigned int));
+    }
+    if ( overflow )
+      memcpy(chain + window_size - preset_size, preset_chain,
+	     preset_size*sizeof(unsigned int));
+  }
+  if ( overflow )
+    for ( i = 0 ; i < preset_size ; i++ )
+      window[ MOD_WINDOW( 1 - preset_size + i ) ] = preset[ i ];
+}
+
+/*
+ * Prepara la ventana para un punto de sincronizacin, tras comprimir
+ * un mensaje. Las cadenas de las look_ahead_size - 1 ltimas
+ * posiciones se insertaron en el rbol con smbolos del look-ahead
+ * buffer que todava no se han ledo, y su lugar en el rbol cambiar
+ * cuando se lean, as que se sacan del rbol hasta el siguiente
+ * mensaje. Las cadenas hash no se tocan: como mucho, alguna de esas
+ * posiciones queda en una lista que no le corresponde y no se
+ * encuentra.
+ */
+void suspend_window() {
+  int p;
+  int k;
+
+  if ( level == TREE_LEVEL ) {
+    if ( !sync_nodes ) {
+      sync_nodes = (int *)malloc(look_ahead_size*sizeof(int));
+      if ( !sync_nodes ) {
+	fprintf(stderr,"lzss: memoria insuficiente\n");
+	exit(1);
+      }
+    }
+    sync_node_count = 0;
+    for ( k = look_ahead_size - 1 ; k > 0 ; k-- ) {
+      p = MOD_WINDOW( current_position - k );
+      if ( tree[ p ].parent != UNUSED ) {
+	DeleteString( p );
+	sync_nodes[ sync_node_count++ ] = p;
       }
     }
   }
+  synced = 1;
+}
+
+/*
+ * Inserta "p" en el rbol, que puede estar vaco.
+ */
+int insert_node(int p, int *match_position) {
+  if ( tree[ tree_root ].larger_child == UNUSED ) {
+    InitTree( p );
+    return 0;
+  }
+  return AddString( p, match_position );
+}
+
+/*
+ * Contina la ventana tras un punto de sincronizacin: carga el
+ * look-ahead buffer con el nuevo mensaje, devuelve al rbol los nodos
+ * que sac suspend_window() y busca la cadena de la posicin actual.
+ */
+void resume_window() {
+  int i;
+  int c;
+  int position;
+
+  for ( i = 0 ; i < look_ahead_size ; i++ ) {
+    if ( ( c = next_symbol() ) == EOF )
+      break;
+    window[ MOD_WINDOW( current_position + i ) ] = (unsigned char) c;
+  }
+  look_ahead_bytes = i;
+  match_length = 0;
+  match_position = 0;
+  extended_length = 0;
+  if ( level == TREE_LEVEL ) {
+    for ( i = 0 ; i < sync_node_count ; i++ )
+      insert_node( sync_nodes[ i ], &position );
+    match_length = insert_node( current_position, &match_position );
+  } else
+    match_length = AddHashString( current_position, &match_position );
+  extend_match();
+  if ( match_length > look_ahead_bytes )
+    match_length = look_ahead_bytes;
+  synced = 0;
+}
+
+/*
+ * Salida en BYTE_FORMAT. Los cdigos se agrupan de 8 en 8, y cada
+ * grupo va precedido de un byte de flags cuyo bit i (empezando por
+ * el menos significativo) indica si el cdigo i del grupo es un
+ * smbolo "k" (1) o un cdigo "ij" (0). Un "k" es el byte del
+ * smbolo. Un "ij" es la distancia a la cadena (offset_bytes bytes,
+ * little-endian) seguida de la longitud menos min_match_length,
+ * codificada como un entero de longitud variable (7 bits por byte,
+ * empezando por los menos significativos; el bit 7 indica que sigue
+ * otro byte). La distancia 0 es END_OF_STREAM.
+ *
+ * El stream comienza con los bytes 0x40 0x00, que equivalen a un bit
+ * 0 seguido de 12 bits de valor 64 (una cabecera con index_size = 1,
+ * imposible en BIT_FORMAT), seguidos de index_size y length_size.
+ */
+#define BYTE_OUTPUT_SIZE 65536
+unsigned char *byte_output;
+unsigned char *byte_out;
+unsigned char *flags;
+int token_count;
+
+void write_byte_header() {
+  int i;
+  byte_output = (unsigned char *)malloc(BYTE_OUTPUT_SIZE + 64);
+  if(!byte_output) {
+    fprintf(stderr,"lzss: memoria insuficiente\n");
+    exit(1);
+  }
+  byte_out = byte_output;
+  *byte_out++ = 0x40;
+  *byte_out++ = BYTE_HEADER_FLAGS;
+  *byte_out++ = index_size;
+  *byte_out++ = length_size;
+  if(dictionary_name)
+    for(i = 0; i < 4; i++)
+      *byte_out++ = (preset_checksum >> (8*i)) & 0xFF;
+  token_count = 0;
+}
+
+void flush_byte_output() {
+  fwrite(byte_output, 1, byte_out - byte_output, stdout);
+  byte_out = byte_output;
+}
+
+/*
+ * Comienza un nuevo cdigo: abre un grupo (y escribe la salida
+ * acumulada) cada 8 cdigos, y anota su flag.
+ */
+void put_byte_token(int flag) {
+  if((token_count & 7) == 0) {
+    if(byte_out - byte_output >= BYTE_OUTPUT_SIZE)
+      flush_byte_output();
+    flags = byte_out++;
+    *flags = 0;
+  }
+  if(flag)
+    *flags |= 1 << (token_count & 7);
+  token_count++;
+}
+
+void put_byte_match(int distance, int length) {
+  int i;
+  put_byte_token(0);
+  for(i=0; i<offset_bytes; i++)
+    *byte_out++ = (unsigned char)(distance >> (8*i));
+  length -= min_match_length;
+  while(length >= 0x80) {
+    *byte_out++ = (unsigned char)(length | 0x80);
+    length >>= 7;
+  }
+  *byte_out++ = (unsigned char)length;
+}
+
+/*
+ * Bytes que ocupa la longitud de una cadena en BYTE_FORMAT.
+ */
+int varint_size(int length) {
+  int n = 1;
+  for(length -= min_match_length; length >= 0x80; length >>= 7)
+    n++;
+  return n;
+}
+
+/*
+ * Salida en ENTROPY_FORMAT. Los cdigos se acumulan en bloques de
+ * hasta ENTROPY_BLOCK_SIZE smbolos "k" y ENTROPY_BLOCK_SIZE cadenas
+ * "ij". Los smbolos forman un stream y las cadenas otro, en el que
+ * cada cadena es una "secuencia": el nmero de smbolos "k" que la
+ * preceden, su longitud menos min_match_length y su distancia menos
+ * 1. Los smbolos que siguen a la ltima cadena del bloque no
+ * necesitan secuencia. Cada bloque es:
+ *
+ *  n de smbolos, n de secuencias, tamao del stream de smbolos,
+ *  tamao del stream de secuencias, stream de smbolos, stream de
+ *  secuencias
+ *
+ * donde los cuatro primeros campos son enteros de longitud variable
+ * como los de BYTE_FORMAT. Un bloque sin smbolos ni secuencias
+ * indica el final del code-stream. Como el tamao de cada stream se
+ * conoce, los dos se pueden descodificar por separado (y en
+ * paralelo).
+ *
+ * El stream de smbolos contiene las longitudes de los cdigos de
+ * Huffman cannicos de los 256 smbolos (output_lengths()) seguidas
+ * de los cdigos. En el de secuencias, cada uno de los tres valores
+ * de una secuencia se representa, como en Deflate, por un "slot"
+ * (ver value_slot()) y unos bits extra; el stream contiene las
+ * longitudes de los tres cdigos de slots seguidas, para cada
+ * secuencia, de los tres slots y despus de sus tres campos de bits
+ * extra. Los cdigos no superan ENTROPY_MAX_CODE_LENGTH bits y, como
+ * en huff.c, los bits se empaquetan empezando por el menos
+ * significativo de cada byte.
+ *
+ * El stream comienza con los bytes 0x20 0x00 (una cabecera de
+ * BIT_FORMAT con length_size = 0), seguidos de index_size y
+ * length_size.
+ */
+#define ENTROPY_BLOCK_SIZE 65536
+#define ENTROPY_MAX_CODE_LENGTH 11
+#define SLOTS 48
+#define SECTION_PADDING 32
+unsigned char *entropy_literals;
+int *sequence_run;
+int *sequence_length;
+int *sequence_distance;
+int literal_count;
+int sequence_count;
+int literal_run;
+unsigned char *section_output;
+unsigned char *section_out;
+unsigned long long section_bits;
+int section_count;
+
+void write_entropy_header() {
+  int i;
+  entropy_literals = (unsigned char *)malloc(ENTROPY_BLOCK_SIZE);
+  sequence_run = (int *)malloc(ENTROPY_BLOCK_SIZE*sizeof(int));
+  sequence_length = (int *)malloc(ENTROPY_BLOCK_SIZE*sizeof(int));
+  sequence_distance = (int *)malloc(ENTROPY_BLOCK_SIZE*sizeof(int));
+  /* Un smbolo ocupa como mucho 11 bits y una secuencia
+     3*11 + 14 + 15 + 22. */
+  section_output = (unsigned char *)malloc(ENTROPY_BLOCK_SIZE*12 + 1024);
+  if(!entropy_literals || !sequence_run || !sequence_length ||
+     !sequence_distance || !section_output) {
+    fprintf(stderr,"lzss: memoria insuficiente\n");
+    exit(1);
+  }
+  putchar(0x20);
+  putchar(BYTE_HEADER_FLAGS);
+  putchar(index_size);
+  putchar(length_size);
+  if(dictionary_name)
+    for(i = 0; i < 4; i++)
+      putchar((preset_checksum >> (8*i)) & 0xFF);
+  literal_count = sequence_count = literal_run = 0;
+}
+
+/*
+ * Slot de un valor: los valores 0 a 3 tienen su propio slot, y los
+ * de "b" bits (b >= 3) se reparten en dos slots, 2(b-1) y 2(b-1) + 1,
+ * segn su segundo bit ms significativo, seguidos de los b-2 bits
+ * restantes. Con SLOTS slots se representan valores de hasta 24 bits.
+ */
+int value_slot(int value) {
+  int b;
+  if(value < 4)
+    return value;
+  for(b = 2; (value >> (b + 1)) != 0; b++)
+    ;
+  return 2*b + ((value >> (b - 1)) & 1);
+}
+
+#define SLOT_EXTRA_BITS(slot) ((slot) < 4 ? 0 : (slot)/2 - 1)
+#define SLOT_BASE(slot) \
+  ((slot) < 4 ? (slot) : (2 | ((slot) & 1)) << ((slot)/2 - 1))
+
+void put_section_bits(int value, int n) {
+  section_bits |= (unsigned long long)value << section_count;
+  section_count += n;
+  while(section_count >= 8) {
+    *section_out++ = (unsigned char)section_bits;
+    section_bits >>= 8;
+    section_count -= 8;
+  }
+}
+
+void end_section() {
+  if(section_count > 0)
+    *section_out++ = (unsigned char)section_bits;
+  section_bits = 0;
+  section_count = 0;
+}
+
+void put_varint(unsigned int x) {
+  while(x >= 0x80) {
+    putchar((int)(x & 0x7F) | 0x80);
+    x >>= 7;
+  }
+  putchar((int)x);
+}
+
+/*
+ * Calcula el cdigo de Huffman cannico de un alfabeto a partir de
+ * los recuentos, escribe sus longitudes en la seccin actual e
+ * invierte los cdigos, para escribirlos con put_section_bits().
+ */
+void put_code(unsigned long *counts, int n, CODE *codes) {
+  int lengths[256];
+  int i;
+  compute_lengths(counts, n, lengths, ENTROPY_MAX_CODE_LENGTH);
+  assign_canonical_codes(lengths, n, codes);
+  output_lengths(lengths, n, put_section_bits);
+  for(i = 0; i < n; i++)
+    codes[i].code = reverse_bits(codes[i].code, codes[i].code_bits);
+}
+
+#define PUT_SYMBOL(codes, s) \
+  put_section_bits((codes)[s].code, (codes)[s].code_bits)
+
+void flush_entropy_block() {
+  unsigned long counts[3][256];
+  CODE codes[3][256];
+  int value[3];
+  int slot[3];
+  int literal_size;
+  int i;
+  int k;
+
+  section_out = section_output;
+  section_bits = 0;
+  section_count = 0;
+  if(literal_count > 0) {
+    memset(counts[0], 0, sizeof(counts[0]));
+    for(i = 0; i < literal_count; i++)
+      counts[0][entropy_literals[i]]++;
+    put_code(counts[0], 256, codes[0]);
+    for(i = 0; i < literal_count; i++)
+      PUT_SYMBOL(codes[0], entropy_literals[i]);
+    end_section();
+  }
+  literal_size = section_out - section_output;
+
+  if(sequence_count > 0) {
+    memset(counts, 0, sizeof(counts));
+    for(i = 0; i < sequence_count; i++) {
+      counts[0][value_slot(sequence_run[i])]++;
+      counts[1][value_slot(sequence_length[i])]++;
+      counts[2][value_slot(sequence_distance[i])]++;
+    }
+    for(k = 0; k < 3; k++)
+      put_code(counts[k], SLOTS, codes[k]);
+    for(i = 0; i < sequence_count; i++) {
+      value[0] = sequence_run[i];
+      value[1] = sequence_length[i];
+      value[2] = sequence_distance[i];
+      for(k = 0; k < 3; k++) {
+	slot[k] = value_slot(value[k]);
+	PUT_SYMBOL(codes[k], slot[k]);
+      }
+      for(k = 0; k < 3; k++)
+	put_section_bits(value[k] - SLOT_BASE(slot[k]),
+			 SLOT_EXTRA_BITS(slot[k]));
+    }
+    end_section();
+  }
+
+  put_varint(literal_count);
+  put_varint(sequence_count);
+  put_varint(literal_size);
+  put_varint(section_out - section_output - literal_size);
+  fwrite(section_output, 1, section_out - section_output, stdout);
+  literal_count = sequence_count = literal_run = 0;
+}
+
+void put_entropy_match(int distance, int length) {
+  sequence_run[sequence_count] = literal_run;
+  sequence_length[sequence_count] = length - min_match_length;
+  sequence_distance[sequence_count] = distance - 1;
+  literal_run = 0;
+  if(++sequence_count == ENTROPY_BLOCK_SIZE)
+    flush_entropy_block();
+}
+
+/*
+ * "k": Un-encoded output.
+ */
+void put_literal(int c) {
+  if(format == BYTE_FORMAT) {
+    put_byte_token(1);
+    *byte_out++ = (unsigned char)c;
+    return;
+  }
+  if(format == ENTROPY_FORMAT) {
+    entropy_literals[literal_count++] = (unsigned char)c;
+    literal_run++;
+    if(literal_count == ENTROPY_BLOCK_SIZE)
+      flush_entropy_block();
+    return;
+  }
+  put_bit(1);
+  put_bits(c, 8);
+}
+
+/*
+ * "ij": Encoded output. "at" es la posicin de la ventana en la que
+ * comienza la cadena que se codifica.
+ */
+void put_match(int position, int length, int at) {
+  if(format == BYTE_FORMAT) {
+    put_byte_match(MOD_WINDOW(at - position), length);
+    return;
+  }
+  if(format == ENTROPY_FORMAT) {
+    put_entropy_match(MOD_WINDOW(at - position), length);
+    return;
+  }
+  put_bit(0);
+  put_bits(position, index_size);
+  put_bits((length - (min_encoded_string_size + 1)), length_size );
+}
+
+/*
+ * Los costes del parsing ptimo se miden en octavos de bit, para que
+ * los de ENTROPY_FORMAT, que son estimaciones, no se redondeen.
+ */
+#define BITS(n) ((n) << 3)
+
+/*
+ * Precios estimados de ENTROPY_FORMAT: la longitud del cdigo de
+ * cada smbolo "k" y de cada slot de longitud y de distancia, y la
+ * media de lo que ocupa el nmero de smbolos que precede a una
+ * secuencia (que el parsing no conoce hasta el final). Se calculan
+ * como log2(total/recuento) a partir de lo elegido en los bloques
+ * anteriores, cuyos recuentos se reducen a la mitad en cada bloque.
+ */
+unsigned long literal_counts[256];
+unsigned long length_counts[SLOTS];
+unsigned long distance_counts[SLOTS];
+unsigned long run_counts[SLOTS];
+int literal_price[256];
+int length_price[SLOTS];
+int distance_price[SLOTS];
+int run_price;
+int priced = 0;
+
+/*
+ * log2(x) en octavos de bit, interpolando linealmente entre potencias
+ * de 2 (el error es menor de 0,1 bits).
+ */
+int log2_price(unsigned long x) {
+  int b;
+  for(b = 0; (x >> (b + 1)) != 0; b++)
+    ;
+  if(b >= 3)
+    return BITS(b) + (int)((x >> (b - 3)) & 7);
+  return BITS(b) + (int)((x << (3 - b)) & 7);
+}
+
+/*
+ * Calcula los precios de un alfabeto. Los smbolos que no se han
+ * elegido cuentan como si hubieran aparecido una vez, y ningn
+ * cdigo baja de 1 bit ni pasa de ENTROPY_MAX_CODE_LENGTH bits.
+ */
+void set_prices(unsigned long *counts, int n, int *prices) {
+  unsigned long total = 0;
+  int total_price;
+  int i;
+  for(i = 0; i < n; i++)
+    total += counts[i] + 1;
+  total_price = log2_price(total);
+  for(i = 0; i < n; i++) {
+    prices[i] = total_price - log2_price(counts[i] + 1);
+    if(prices[i] < BITS(1))
+      prices[i] = BITS(1);
+    if(prices[i] > BITS(ENTROPY_MAX_CODE_LENGTH))
+      prices[i] = BITS(ENTROPY_MAX_CODE_LENGTH);
+  }
+}
+
+void update_prices() {
+  int prices[SLOTS];
+  unsigned long runs = 0;
+  unsigned long sum = 0;
+  int i;
+  set_prices(literal_counts, 256, literal_price);
+  set_prices(length_counts, SLOTS, length_price);
+  set_prices(distance_counts, SLOTS, distance_price);
+  set_prices(run_counts, SLOTS, prices);
+  for(i = 0; i < SLOTS; i++) {
+    runs += run_counts[i];
+    sum += run_counts[i]*(prices[i] + BITS(SLOT_EXTRA_BITS(i)));
+  }
+  run_price = runs ? (int)(sum/runs) : BITS(1);
+  priced = 1;
+}
+
+/*
+ * Coste de un smbolo "k".
+ */
+int literal_cost(int c) {
+  if(format == ENTROPY_FORMAT)
+    return literal_price[c];
+  return BITS(9);
+}
+
+/*
+ * Coste de un cdigo "ij", que se divide en la parte que depende de
+ * la longitud y la que depende de la distancia. En ENTROPY_FORMAT,
+ * los bits extra de los slots son exactos y el resto, los precios
+ * estimados.
+ */
+int match_cost(int length) {
+  int slot;
+  if(format == BYTE_FORMAT)
+    return BITS(1 + 8*(offset_bytes + varint_size(length)));
+  if(format == ENTROPY_FORMAT) {
+    slot = value_slot(length - min_match_length);
+    return run_price + length_price[slot] + BITS(SLOT_EXTRA_BITS(slot));
+  }
+  return BITS(1 + index_size + length_size);
+}
+
+int distance_cost(int distance) {
+  int slot;
+  if(format != ENTROPY_FORMAT)
+    return 0;
+  slot = value_slot(distance - 1);
+  return distance_price[slot] + BITS(SLOT_EXTRA_BITS(slot));
+}
+
+/*
+ * Parsing ptimo. Para cada posicin del bloque se guardan el
+ * smbolo y la cadena ms larga encontrada. Como el tamao de un
+ * cdigo "ij" slo depende de la distancia y de la longitud, y
+ * cualquier prefijo de una cadena encontrada tambin est en el
+ * diccionario a la misma distancia, basta con la cadena ms larga de
+ * cada posicin para calcular, de atrs hacia delante, el mnimo
+ * coste "cost[i]" con el que se pueden codificar los
+ * smbolos desde "i" hasta el final del bloque. Las cadenas de
+ * OPTIMAL_NICE_LENGTH smbolos o ms slo se consideran enteras, lo
+ * que evita que el coste sea proporcional al tamao del look-ahead
+ * buffer. "length_cost[k]" es match_cost(k), que se calcula al
+ * comienzo del bloque. En ENTROPY_FORMAT, el primer bloque se
+ * analiza dos veces: la primera, slo para tener recuentos con los
+ * que estimar los precios.
+ */
+#define PARSE_BLOCK_SIZE 65536
+#define OPTIMAL_NICE_LENGTH 128
+unsigned char *block_literal;
+int *block_length;
+int *block_position;
+int *cost;
+int *choice;
+int *length_cost;
+
+void alloc_parse_block() {
+  if(block_literal)
+    return;
+  block_literal = (unsigned char *)malloc(PARSE_BLOCK_SIZE);
+  block_length = (int *)malloc(PARSE_BLOCK_SIZE*sizeof(int));
+  block_position = (int *)malloc(PARSE_BLOCK_SIZE*sizeof(int));
+  cost = (int *)malloc((PARSE_BLOCK_SIZE + 1)*sizeof(int));
+  choice = (int *)malloc(PARSE_BLOCK_SIZE*sizeof(int));
+  length_cost = (int *)malloc((look_ahead_size + 1)*sizeof(int));
+  if(!block_literal || !block_length || !block_position ||
+     !cost || !choice || !length_cost) {
+    fprintf(stderr,"lzss: memoria insuficiente\n");
+    exit(1);
+  }
+}
+
+void find_choices(int n, int block_start) {
+  int i;
+  int k;
+  int first;
+  int length;
+  int distance;
+
+  for ( k = min_match_length ; k <= look_ahead_size ; k++ )
+    length_cost[ k ] = match_cost(k);
+  cost[ n ] = 0;
+  for ( i = n - 1 ; i >= 0 ; i-- ) {
+    cost[ i ] = cost[ i + 1 ] + literal_cost(block_literal[ i ]);
+    choice[ i ] = 1;
+    length = block_length[ i ];
+    if ( length > n - i )
+      length = n - i;
+    if ( length >= min_match_length ) {
+      distance = distance_cost(MOD_WINDOW( block_start + i -
+					    block_position[ i ] ));
+      first = min_match_length;
+      if ( length >= OPTIMAL_NICE_LENGTH )
+	first = length;
+      for ( k = length ; k >= first ; k-- )
+	if ( cost[ i + k ] + length_cost[ k ] + distance < cost[ i ] ) {
+	  cost[ i ] = cost[ i + k ] + length_cost[ k ] + distance;
+	  choice[ i ] = k;
+	}
+    }
+  }
+}
+
+/*
+ * Aade a los recuentos de ENTROPY_FORMAT lo elegido en el bloque.
+ */
+void count_choices(int n, int block_start) {
+  int i;
+  int run = 0;
+  int distance;
+
+  for ( i = 0 ; i < 256 ; i++ )
+    literal_counts[ i ] /= 2;
+  for ( i = 0 ; i < SLOTS ; i++ ) {
+    length_counts[ i ] /= 2;
+    distance_counts[ i ] /= 2;
+    run_counts[ i ] /= 2;
+  }
+  for ( i = 0 ; i < n ; i += choice[ i ] )
+    if ( choice[ i ] == 1 ) {
+      literal_counts[ block_literal[ i ] ]++;
+      run++;
+    } else {
+      distance = MOD_WINDOW( block_start + i - block_position[ i ] );
+      length_counts[ value_slot(choice[ i ] - min_match_length) ]++;
+      distance_counts[ value_slot(distance - 1) ]++;
+      run_counts[ value_slot(run) ]++;
+      run = 0;
+    }
+  update_prices();
+}
+
+void parse_block(int n, int block_start) {
+  int i;
+
+  if ( format == ENTROPY_FORMAT ) {
+    if ( !priced ) {
+      update_prices();
+      find_choices(n, block_start);
+      count_choices(n, block_start);
+    }
+    find_choices(n, block_start);
+    count_choices(n, block_start);
+  } else
+    find_choices(n, block_start);
+  for ( i = 0 ; i < n ; i += choice[ i ] )
+    if ( choice[ i ] == 1 )
+      put_literal(block_literal[ i ]);
+    else
+      put_match(block_position[ i ], choice[ i ],
+		MOD_WINDOW( block_start + i ));
+}
+
+/*
+ * Parsing voraz o "lazy" de un bloque de posiciones, como el de
+ * encode_stream(), a partir de las cadenas guardadas por
+ * encode_suffix_blocks().
+ */
+void put_block(int n, int block_start) {
+  int i;
+  int length;
+
+  for ( i = 0 ; i < n ; ) {
+    length = block_length[ i ];
+    if ( length > n - i )
+      length = n - i;
+    if ( length < min_match_length ||
+	 ( parsing == LAZY && length < look_ahead_size &&
+	   i + 1 < n && block_length[ i + 1 ] > length ) ) {
+      put_literal(block_literal[ i ]);
+      i++;
+    } else {
+      put_match(block_position[ i ], length, MOD_WINDOW( block_start + i ));
+      i += length;
+    }
+  }
+}
+
+/*
+ * Trozo de la entrada que procesa un hilo de "-s" o "-p": "size"
+ * smbolos a partir de "sa_text + start", precedidos de "history"
+ * smbolos vlidos y seguidos de "after" (los que hay hasta el final
+ * de la ronda, como mucho look_ahead_size). Para cada posicin "p"
+ * del trozo, sa_length[p] es la longitud de la cadena ms larga
+ * encontrada y sa_source[p] la posicin de sa_text en la que
+ * comienza.
+ */
+typedef struct {
+  int start;
+  int size;
+  int history;
+  int after;
+} SA_CHUNK;
+
+unsigned char *sa_text;
+int *sa_length;
+int *sa_source;
+
+void *find_chunk_matches(void *arg) {
+  SA_CHUNK *chunk = (SA_CHUNK *)arg;
+  int *sa;
+  int *lcp;
+  int *length;
+  int *source;
+  int block;
+  int history;
+  int from;
+  int size;
+  int n;
+  int i;
+
+  size = ( sa_history_size + sa_block_size )*sizeof(int);
+  sa = (int *)malloc(size);
+  lcp = (int *)malloc(size);
+  length = (int *)malloc(size);
+  source = (int *)malloc(size);
+  if ( !sa || !lcp || !length || !source ) {
+    fprintf(stderr,"lzss: memoria insuficiente\n");
+    exit(1);
+  }
+  history = chunk->history;
+  for ( block = chunk->start ; block < chunk->start + chunk->size ;
+	block += n ) {
+    n = chunk->start + chunk->size - block;
+    if ( n > sa_block_size )
+      n = sa_block_size;
+    if ( history > sa_history_size )
+      history = sa_history_size;
+    from = block - history;
+    suffix_array(sa_text + from, history + n, sa, END_SMALLEST);
+    lcp_array(sa_text + from, history + n, sa, lcp);
+    longest_previous_factor(sa, lcp, history + n, length, source);
+    for ( i = 0 ; i < n ; i++ ) {
+      sa_length[ block + i ] = length[ history + i ];
+      sa_source[ block + i ] = from + source[ history + i ];
+    }
+    history += n;
+  }
+  free(sa);
+  free(lcp);
+  free(length);
+  free(source);
+  return NULL;
+}
+
+/*
+ * Compresin con "-s" o "-p". La entrada se lee en rondas de hasta
+ * chunk_threads trozos, que se procesan en paralelo (el hilo que llama
+ * procesa el primero). Despus, las cadenas encontradas se codifican
+ * en orden, en bloques de PARSE_BLOCK_SIZE posiciones, con el parsing
+ * seleccionado. El smbolo de la posicin absoluta "a" de la entrada
+ * ocupa la posicin MOD_WINDOW(1 + a) de la ventana del
+ * descompresor; en BIT_FORMAT, una cadena que comienza en la
+ * posicin 0 no se puede codificar (es END_OF_STREAM). El histrico
+ * inicial es el final del diccionario predefinido.
+ */
+int sa_chunk_size;
+
+/*
+ * Hilo de "-p": recorre el trozo con advance(), como el compresor
+ * secuencial, en una ventana propia por la que primero pasan los
+ * smbolos anteriores al trozo. Si lo ejecuta el hilo que llama, se
+ * conserva su registro.
+ */
+void *find_window_matches(void *arg) {
+  SA_CHUNK *chunk = (SA_CHUNK *)arg;
+  unsigned char *saved_record = record;
+  int saved_length = record_length;
+  int saved_position = record_position;
+  int history;
+  int from;
+  int i;
+  int c;
+  int p;
+
+  history = chunk->history;
+  if ( history > sa_history_size )
+    history = sa_history_size;
+  from = chunk->start - history;
+  alloc_finder();
+  record = sa_text + from;
+  record_length = history + chunk->size + chunk->after;
+  record_position = 0;
+
+  current_position = 1;
+  for ( i = 0 ; i < look_ahead_size ; i++ ) {
+    if ( ( c = next_symbol() ) == EOF )
+      break;
+    window[ current_position + i ] = (unsigned char) c;
+  }
+  look_ahead_bytes = i;
+  match_length = 0;
+  match_position = 0;
+  extended_length = 0;
+  if ( level == TREE_LEVEL )
+    InitTree( current_position );
+  else
+    InitHash( current_position );
+  for ( p = 0 ; p < history + chunk->size ; p++ ) {
+    if ( p >= history ) {
+      sa_length[ from + p ] = match_length;
+      sa_source[ from + p ] = from + p -
+	MOD_WINDOW( current_position - match_position );
+    }
+    advance(1);
+  }
+
+  free(window);
+  free(tree);
+  free(head);
+  free(chain);
+  window = NULL;
+  tree = NULL;
+  head = chain = NULL;
+  record = saved_record;
+  record_length = saved_length;
+  record_position = saved_position;
+  return NULL;
+}
+
+void init_suffix_blocks() {
+  int size;
+
+  if ( !suffix_arrays ) {
+    sa_history_size = window_size - look_ahead_size;
+    sa_chunk_size = SA_CHUNK_SIZE;
+    if ( sa_chunk_size < 4*window_size )
+      sa_chunk_size = 4*window_size;
+  } else {
+    sa_block_size = (window_size - look_ahead_size) / 2;
+    if ( sa_block_size > SA_BLOCK_SIZE )
+      sa_block_size = SA_BLOCK_SIZE;
+    if ( sa_block_size < 1 )
+      sa_block_size = 1;
+    sa_history_size = window_size - look_ahead_size - sa_block_size;
+    if ( sa_history_size > sa_block_size )
+      sa_history_size = sa_block_size;
+    sa_chunk_size = sa_block_size;
+    if ( sa_chunk_size < SA_CHUNK_SIZE )
+      sa_chunk_size *= SA_CHUNK_SIZE / sa_block_size;
+  }
+
+  size = sa_history_size + chunk_threads*sa_chunk_size;
+  sa_text = (unsigned char *)malloc(size);
+  sa_length = (int *)malloc(size*sizeof(int));
+  sa_source = (int *)malloc(size*sizeof(int));
+  if ( !sa_text || !sa_length || !sa_source ) {
+    fprintf(stderr,"lzss: memoria insuficiente\n");
+    exit(1);
+  }
+  alloc_parse_block();
+}
+
+void encode_suffix_blocks() {
+  SA_CHUNK chunk[MAX_THREADS];
+  pthread_t thread[MAX_THREADS];
+  void *(*finder)(void *);
+  unsigned int stream_position;
+  int chunk_size = sa_chunk_size;
+  int history_bytes;
+  int base = sa_history_size;
+  int size;
+  int threads;
+  int t;
+  int i;
+  int k;
+  int n;
+  int p;
+  int length;
+  int position;
+
+  finder = suffix_arrays ? find_chunk_matches : find_window_matches;
+  stream_position = 0;
+  history_bytes = preset_size < base ? preset_size : base;
+  if ( history_bytes > 0 )
+    memcpy(sa_text + base - history_bytes,
+	   preset + preset_size - history_bytes, history_bytes);
+  while ( ( size = read_symbols(sa_text + base,
+				chunk_threads*chunk_size) ) > 0 ) {
+    threads = ( size + chunk_size - 1 ) / chunk_size;
+    for ( t = 0 ; t < threads ; t++ ) {
+      chunk[ t ].start = base + t*chunk_size;
+      chunk[ t ].size = t < threads - 1 ? chunk_size : size - t*chunk_size;
+      chunk[ t ].history = history_bytes + t*chunk_size;
+      chunk[ t ].after = size - ( t + 1 )*chunk_size;
+      if ( chunk[ t ].after < 0 )
+	chunk[ t ].after = 0;
+      if ( chunk[ t ].after > look_ahead_size )
+	chunk[ t ].after = look_ahead_size;
+    }
+    for ( t = 1 ; t < threads ; t++ )
+      if ( pthread_create(&thread[ t ], NULL, finder, &chunk[ t ]) ) {
+	fprintf(stderr,"lzss: no se puede crear un hilo\n");
+	exit(1);
+      }
+    finder(&chunk[ 0 ]);
+    for ( t = 1 ; t < threads ; t++ )
+      pthread_join(thread[ t ], NULL);
+
+    for ( i = 0 ; i < size ; i += n ) {
+      n = size - i;
+      if ( n > PARSE_BLOCK_SIZE )
+	n = PARSE_BLOCK_SIZE;
+      for ( k = 0 ; k < n ; k++ ) {
+	p = base + i + k;
+	block_literal[ k ] = sa_text[ p ];
+	length = sa_length[ p ];
+	if ( length > look_ahead_size )
+	  length = look_ahead_size;
+	position = MOD_WINDOW( 1 + stream_position + sa_source[ p ] - base );
+	if ( format == BIT_FORMAT && position == END_OF_STREAM )
+	  length = 0;
+	block_length[ k ] = length;
+	block_position[ k ] = position;
+      }
+      if ( parsing == OPTIMAL )
+	parse_block(n, MOD_WINDOW( 1 + stream_position + i ));
+      else
+	put_block(n, MOD_WINDOW( 1 + stream_position + i ));
+    }
+
+    /* Los ltimos smbolos ledos son el histrico de la siguiente
+       ronda. */
+    stream_position += size;
+    history_bytes += size;
+    if ( history_bytes > sa_history_size )
+      history_bytes = sa_history_size;
+    memmove(sa_text + base - history_bytes,
+	    sa_text + base + size - history_bytes, history_bytes);
+  }
+}
+
+/*
+ * Escribe END_OF_STREAM y vaca la salida. En modo registro, el
+ * siguiente registro comienza en un lmite de byte (y en BYTE_FORMAT,
+ * con un nuevo grupo de cdigos).
+ */
+void put_end_of_stream() {
+  if ( format == BYTE_FORMAT ) {
+    put_byte_match(END_OF_STREAM, min_match_length);
+    flush_byte_output();
+    token_count = 0;
+    return;
+  }
+  if ( format == ENTROPY_FORMAT ) {
+    if ( literal_count > 0 || sequence_count > 0 )
+      flush_entropy_block();
+    put_varint(0);
+    put_varint(0);
+    return;
+  }
+  put_bit(0);
+  put_bits(END_OF_STREAM, index_size);
+  if ( records )
+    align_output();
+  else
+    flush();
+}
+
+/*
+ * Escribe un punto de sincronizacin y entrega la salida.
+ */
+void put_sync_point() {
+  suspend_window();
+  if ( format == BYTE_FORMAT ) {
+    put_byte_match(END_OF_STREAM, min_match_length + 1);
+    flush_byte_output();
+    token_count = 0;
+  } else if ( format == ENTROPY_FORMAT ) {
+    if ( literal_count > 0 || sequence_count > 0 )
+      flush_entropy_block();
+    put_varint(0);
+    put_varint(0);
+    put_varint(1);
+  } else {
+    put_bit(0);
+    put_bits(END_OF_STREAM, index_size);
+    put_bits(1, length_size);
+    align_output();
+  }
+  fflush(stdout);
+}
+
+/*
+ * Carga el buffer de anticipacin e inicializa el buscador de cadenas
+ * al comienzo de la entrada (o del registro actual).
+ */
+void start_window() {
+  int i;
+  int c;
+
+  current_position = 1;
+  for ( i = 0 ; i < look_ahead_size ; i++ ) {
+    if ( ( c = next_symbol() ) == EOF )
+      break;
+    window[ current_position + i ] = (unsigned char) c;
+  }
+  look_ahead_bytes = i; /* look_ahead_bytes = 17, excepto al final de
+			   la compresin. */
+
+  /* Longitud de la cadena encontrada. */
+  match_length = 0;
+
+  /* Posicin de la cadena encontrada. */
+  match_position = 0;
+  extended_length = 0;
+
+  /* Inicializa el rbol de bsqueda binario (o las cadenas hash). Si
+     ya contiene el diccionario predefinido, la primera posicin
+     tambin se busca. */
+  if ( level == TREE_LEVEL ) {
+    if ( tree[ tree_root ].larger_child == UNUSED )
+      InitTree( current_position );
+    else
+      match_length = AddString( current_position, &match_position );
+  } else if ( preset_size > 0 || records ) {
+    hash_position = window_size;
+    match_length = AddHashString( current_position, &match_position );
+  } else
+    InitHash( current_position );
+  extend_match();
+  if ( match_length > look_ahead_bytes )
+    match_length = look_ahead_bytes;
+}
+
+/*
+ * Comprime la entrada (o el registro actual).
+ */
+void encode_symbols() {
+  int c;
+  int n;
+  int lazy_length;
+  int lazy_position;
+  int block_start;
+
+  if ( chunk_threads ) {
+    encode_suffix_blocks();
+    return;
+  }
+  if ( synced )
+    resume_window();
+  else
+    start_window();
+
+  if ( parsing == OPTIMAL ) {
+    alloc_parse_block();
+    while ( look_ahead_bytes > 0 ) {
+      block_start = current_position;
+      for ( n = 0 ; n < PARSE_BLOCK_SIZE && look_ahead_bytes > 0 ; n++ ) {
+	block_literal[ n ] = window[ current_position ];
+	block_length[ n ] = match_length;
+	block_position[ n ] = match_position;
+	advance(1);
+      }
+      parse_block(n, block_start);
+    }
+  }
+
+  /* Comienza la compresin. */
+  while ( look_ahead_bytes > 0 ) {
+    /* Decidimos si enviar una "k" o un cdigo "ij". */
+    if ( match_length < min_match_length ) {
+      put_literal(window[ current_position ]);
+      advance(1);
+    } else if ( parsing == LAZY && match_length < look_ahead_size ) {
+      /* Si la cadena de la siguiente posicin es ms larga, enviamos
+	 el smbolo actual y la decisin se repite all. */
+      c = window[ current_position ];
+      lazy_length = match_length;
+      lazy_position = match_position;
+      advance(1);
+      if ( match_length > lazy_length )
+	put_literal(c);
+      else {
+	put_match(lazy_position, lazy_length,
+		  MOD_WINDOW( current_position - 1 ));
+	advance(lazy_length - 1);
+      }
+    } else {
+      put_match(match_position, match_length, current_position);
+      advance(match_length);
+    }
+  };
+}
+
+/*
+ * Realiza la compresin del stream.
+ */
+void encode_stream(int argc, char *argv[]) {
+  parse_options(argc, argv);
+  init_window(1);
+  /* La cabecera lleva el resumen del diccionario predefinido. */
+  load_preset();
+  if ( format == BYTE_FORMAT )
+    write_byte_header();
+  else if ( format == ENTROPY_FORMAT )
+    write_entropy_header();
+  else if ( index_size != INDEX_SIZE || length_size != LENGTH_SIZE ||
+	    dictionary_name || records )
+    /* Con un diccionario, el primer cdigo puede ser un "ij" que
+       parecera una cabecera. */
+    write_header();
+
+  if ( chunk_threads )
+    init_suffix_blocks();
+  else if ( preset_size > 0 || records )
+    init_preset();
+
+  if ( sync_flush ) {
+    /* Cada mensaje contina la ventana del anterior. */
+    while ( read_record() > 0 ) {
+      encode_symbols();
+      put_sync_point();
+    }
+    put_end_of_stream();
+    return;
+  }
+  if ( !records ) {
+    encode_symbols();
+    /* EOF alcanzado. */
+    put_end_of_stream();
+    return;
+  }
+  /* Cada registro es un stream completo que comienza en un lmite de
+     byte. */
+  if ( format == BIT_FORMAT )
+    align_output();
+  while ( read_record() > 0 ) {
+    encode_symbols();
+    put_end_of_stream();
+    if ( !chunk_threads )
+      reset_window(record_length);
+  }
+  /* Sin registros, la cabecera de BYTE_FORMAT sigue en el buffer. */
+  if ( format == BYTE_FORMAT )
+    flush_byte_output();
+}
+
+/*
+ * Lectura de bits para el descompresor. El code-stream se lee en
+ * bloques de IO_BUFFER_SIZE bytes y los bits se acumulan en "bits",
+ * alineados a la izquierda: el siguiente bit es el ms significativo
+ * y los "count" primeros son vlidos. Como get_bits(), los valores se
+ * leen empezando por su bit ms significativo, y como put_bits()
+ * escribe primero los bits menos significativos de cada byte, cada
+ * byte se invierte (reversed[]) al cargarlo. Tras el final del
+ * code-stream se leen ceros, que forman un END_OF_STREAM;
+ * "padding_bits" de los "count" bits son de ese relleno.
+ */
+#define IO_BUFFER_SIZE 65536
+#define INPUT_PADDING 64
+static unsigned char input_buffer[IO_BUFFER_SIZE + INPUT_PADDING];
+static unsigned char *input_end = input_buffer;
+static unsigned char *in = input_buffer;
+static unsigned char reversed[256];
+static unsigned long long bits;
+static int count;
+static int padding_bits;
+
+/*
+ * Garantiza que hay al menos 57 bits en "bits", suficientes para
+ * cualquier cdigo "k" o "ij".
+ */
+static void refill_bits() {
+  size_t n;
+  while ( count <= 56 ) {
+    if ( in == input_end ) {
+      n = fread(input_buffer, 1, IO_BUFFER_SIZE, stdin);
+      in = input_buffer;
+      input_end = input_buffer + n;
+      if ( n == 0 ) {
+	/* Se rellena con bytes completos, para que align_bits() siga
+	   funcionando. */
+	padding_bits += ( 64 - count ) & ~7;
+	count += ( 64 - count ) & ~7;
+	return;
+      }
+    }
+    bits |= (unsigned long long) reversed[ *in++ ] << ( 56 - count );
+    count += 8;
+  }
+}
+
+/*
+ * Conserva los bytes an no ledos y rellena el resto del buffer de
+ * entrada. Tras el final de la entrada quedan INPUT_PADDING bytes a 0.
+ */
+static void reload_input() {
+  size_t n = in < input_end ? input_end - in : 0;
+  memmove(input_buffer, in, n);
+  n += fread(input_buffer + n, 1, IO_BUFFER_SIZE - n, stdin);
+  in = input_buffer;
+  input_end = input_buffer + n;
+  memset(input_end, 0, INPUT_PADDING);
+}
+
+/*
+ * Con "-f" el descompresor no lee por adelantado, para no quedarse
+ * esperando datos que el compresor todava no ha enviado: lee, byte a
+ * byte, slo los que necesita. need_input() garantiza que hay al
+ * menos "n" bytes en el buffer de entrada (tras el final de la
+ * entrada, bytes a 0), need_bits() que hay al menos "n" bits, y
+ * refill_token() los bits de un cdigo "ij" (un punto de
+ * sincronizacin ocupa lo mismo, as que nunca se piden bits que
+ * estn detrs de l).
+ */
+static void need_input(int n) {
+  int c;
+  if ( in + n > input_buffer + IO_BUFFER_SIZE ) {
+    memmove(input_buffer, in, input_end - in);
+    input_end -= in - input_buffer;
+    in = input_buffer;
+  }
+  while ( input_end - in < n ) {
+    c = getchar();
+    *input_end++ = c == EOF ? 0 : (unsigned char) c;
+  }
+}
+
+static void need_bits(int n) {
+  while ( count < n ) {
+    need_input(1);
+    bits |= (unsigned long long) reversed[ *in++ ] << ( 56 - count );
+    count += 8;
+  }
+}
+
+static void refill_token() {
+  need_bits(1 + index_size + length_size);
+}
+
+/*
+ * Extrae los siguientes "n" bits (1 <= n <= 32).
+ */
+#define TAKE_BITS(n) \
+  ( value = (int) ( bits >> ( 64 - (n) ) ), bits <<= (n), count -= (n), value )
+
+/*
+ * Descarta los siguientes "n" bits.
+ */
+#define SKIP_BITS(n) \
+  ( bits <<= (n), count -= (n) )
+
+/*
+ * Descarta los bits que quedan del byte actual.
+ */
+static void align_bits() {
+  bits <<= count & 7;
+  count -= count & 7;
+}
+
+/*
+ * Indica si queda algn registro en la entrada (en modo registro).
+ */
+static int more_input() {
+  if ( format == BIT_FORMAT && count > padding_bits )
+    return 1;
+  if ( in >= input_end )
+    reload_input();
+  return in < input_end;
+}
+
+/*
+ * Copia "length" smbolos que estn "distance" posiciones antes de
+ * "dst". Si las cadenas no se solapan, se copian 16 bytes de una vez
+ * (pudiendo escribir hasta 15 bytes de ms). Si se solapan, la
+ * cadena es peridica y primero se replica el patrn hasta que la
+ * distancia es de al menos 16 bytes.
+ */
+static void copy_match(unsigned char *dst, int distance, int length) {
+  unsigned char *src = dst - distance;
+  unsigned char *end = dst + length;
+  if ( distance == 1 ) {
+    memset(dst, *src, length);
+    return;
+  }
+  while ( distance < 16 && dst < end ) {
+    memcpy(dst, src, distance);
+    dst += distance;
+    distance *= 2;
+  }
+  while ( dst < end ) {
+    memcpy(dst, dst - distance, 16);
+    dst += 16;
+  }
+}
+
+/*
+ * Buffer lineal de salida del descompresor (ver decode_stream()).
+ */
+static unsigned char *output;
+static unsigned char *out;
+static unsigned char *limit;
+static unsigned char *written;
+static int output_flushed;
+
+static void flush_output() {
+  fwrite(written, 1, out - written, stdout);
+  memmove(output, out - window_size, window_size);
+  out = output + window_size;
+  written = out;
+  output_flushed = 1;
+}
+
+/*
+ * Entrega lo descomprimido hasta un punto de sincronizacin, sin
+ * mover la ventana.
+ */
+static void deliver_output() {
+  fwrite(written, 1, out - written, stdout);
+  written = out;
+  fflush(stdout);
+}
+
+/*
+ * Escribe un registro descomprimido y deja en la ventana el
+ * diccionario predefinido para el siguiente (slo hay que restaurarlo
+ * si flush_output() lo ha desplazado).
+ */
+static void write_record() {
+  fwrite(written, 1, out - written, stdout);
+  out = output + window_size;
+  written = out;
+  if ( output_flushed && preset_size > 0 )
+    memcpy(output + window_size - preset_size, preset, preset_size);
+  output_flushed = 0;
+}
+
+/*
+ * Descompresin de BYTE_FORMAT. Cada grupo de 8 cdigos ocupa como
+ * mucho INPUT_PADDING bytes, por lo que basta con comprobar el buffer
+ * de entrada al comienzo del grupo (salvo con "-f", que lo comprueba
+ * en cada cdigo). Tras un punto de sincronizacin comienza un nuevo
+ * grupo.
+ */
+static void decode_bytes() {
+  int b;
+  int c;
+  int flag_bits;
+  int distance;
+  int length;
+  int shift;
+  int sync = sync_flush;
+
+  for ( ; ; ) {
+    if ( sync )
+      need_input(1);
+    else if ( input_end - in < INPUT_PADDING )
+      reload_input();
+    flag_bits = *in++;
+    for ( b = 0 ; b < 8 ; b++, flag_bits >>= 1 ) {
+      if ( sync )
+	need_input(( flag_bits & 1 ) ? 1 : offset_bytes + 1);
+      if ( flag_bits & 1 ) {
+	*out++ = *in++;
+	continue;
+      }
+      distance = in[ 0 ] | in[ 1 ] << 8;
+      if ( offset_bytes == 3 )
+	distance |= in[ 2 ] << 16;
+      in += offset_bytes;
+      if ( distance == END_OF_STREAM ) {
+	/* La longitud de END_OF_STREAM es 0 al final del stream y 1 en
+	   un punto de sincronizacin. */
+	if ( *in++ == 0 )
+	  return;
+	deliver_output();
+	break;
+      }
+      length = 0;
+      shift = 0;
+      do {
+	if ( sync )
+	  need_input(1);
+	c = *in++;
+	length |= ( c & 0x7F ) << shift;
+	shift += 7;
+      } while ( ( c & 0x80 ) && shift < 21 );
+      length += min_match_length;
+      if ( length > look_ahead_size || distance > window_size ) {
+	fprintf(stderr,"lzss: code-stream corrupto\n");
+	exit(1);
+      }
+      copy_match(out, distance, length);
+      out += length;
+    }
+    if ( out >= limit )
+      flush_output();
+  }
+}
+
+/*
+ * Lectura de ENTROPY_FORMAT. Los dos streams de cada bloque se
+ * cargan enteros en "section" (seguidos de SECTION_PADDING bytes a
+ * 0) y sus bits se acumulan en "section_bits" empezando por el menos
+ * significativo. Cada recarga deja al menos 57 bits, que bastan para
+ * los tres slots de una secuencia o para sus bits extra.
+ */
+static unsigned char *section;
+static unsigned char *section_end;
+
+static void corrupt_stream() {
+  fprintf(stderr,"lzss: code-stream corrupto\n");
+  exit(1);
+}
+
+static void refill_section() {
+  while ( section_count <= 56 ) {
+    section_bits |= (unsigned long long) *section++ << section_count;
+    section_count += 8;
+  }
+  if ( section > section_end + SECTION_PADDING/2 )
+    corrupt_stream();
+}
+
+static int get_section_bits(int n) {
+  int value;
+  refill_section();
+  value = (int) ( section_bits & ( ( 1ull << n ) - 1 ) );
+  section_bits >>= n;
+  section_count -= n;
+  return value;
+}
+
+static unsigned int get_varint() {
+  unsigned int x = 0;
+  int shift = 0;
+  int c;
+  if ( !sync_flush && input_end - in < INPUT_PADDING )
+    reload_input();
+  do {
+    if ( sync_flush )
+      need_input(1);
+    c = *in++;
+    x |= (unsigned int) ( c & 0x7F ) << shift;
+    shift += 7;
+  } while ( ( c & 0x80 ) && shift < 35 );
+  return x;
+}
+
+/*
+ * Copia en "dst" los siguientes "size" bytes de la entrada.
+ */
+static void read_section(unsigned char *dst, unsigned int size) {
+  unsigned int n = in < input_end ? input_end - in : 0;
+  if ( n > size )
+    n = size;
+  memcpy(dst, in, n);
+  in += n;
+  if ( n < size && fread(dst + n, 1, size - n, stdin) != size - n )
+    corrupt_stream();
+  memset(dst + size, 0, SECTION_PADDING);
+}
+
+/*
+ * Lee las longitudes de un cdigo de "n" smbolos y construye su
+ * tabla de descodificacin. Las entradas que no corresponden a
+ * ningn cdigo (en un cdigo incompleto) se descodifican como el
+ * smbolo 0.
+ */
+static void get_code(int n, unsigned int *table) {
+  int lengths[256];
+  unsigned int kraft = 0;
+  int i;
+  input_lengths(lengths, n, get_section_bits);
+  for ( i = 0 ; i < n ; i++ ) {
+    if ( lengths[ i ] > ENTROPY_MAX_CODE_LENGTH )
+      corrupt_stream();
+    if ( lengths[ i ] )
+      kraft += 1u << ( ENTROPY_MAX_CODE_LENGTH - lengths[ i ] );
+  }
+  if ( kraft > ( 1u << ENTROPY_MAX_CODE_LENGTH ) )
+    corrupt_stream();
+  for ( i = 0 ; i < ( 1 << ENTROPY_MAX_CODE_LENGTH ) ; i++ )
+    table[ i ] = ENTRY(0, 0, 1, 1, 1);
+  build_decoding_table(lengths, n, table, ENTROPY_MAX_CODE_LENGTH,
+		       LSB_FIRST);
+}
+
+#define DECODE_SLOT(table) \
+  ( e = (table)[ section_bits & mask ], \
+    section_bits >>= ENTRY_LENGTH_1(e), section_count -= ENTRY_LENGTH_1(e), \
+    ENTRY_SYMBOL_1(e) )
+
+#define SLOT_VALUE(slot) \
+  ( value = (int) ( section_bits & ( ( 1u << SLOT_EXTRA_BITS(slot) ) - 1 ) ), \
+    section_bits >>= SLOT_EXTRA_BITS(slot), \
+    section_count -= SLOT_EXTRA_BITS(slot), \
+    SLOT_BASE(slot) + value )
+
+/*
+ * Descompresin de ENTROPY_FORMAT. Primero se descodifica el stream
+ * de smbolos de cada bloque, con hasta dos smbolos por consulta a
+ * la tabla, y despus el de secuencias, que copia los smbolos y las
+ * cadenas a la salida.
+ */
+static void decode_entropy() {
+  static unsigned int table[4][1 << ENTROPY_MAX_CODE_LENGTH];
+  static unsigned char *literals;
+  static unsigned char *buffer;
+  unsigned char *p;
+  unsigned char *end;
+  unsigned int literal_count;
+  unsigned int sequence_count;
+  unsigned int literal_size;
+  unsigned int sequence_size;
+  unsigned int mask = ( 1u << ENTROPY_MAX_CODE_LENGTH ) - 1;
+  unsigned int e;
+  unsigned int s;
+  int slot[3];
+  int value;
+  int run;
+  int length;
+  int distance;
+  int k;
+
+  /* En modo registro se reservan una sola vez. */
+  if ( !literals ) {
+    literals = (unsigned char *)malloc(ENTROPY_BLOCK_SIZE + 2);
+    buffer = (unsigned char *)malloc(ENTROPY_BLOCK_SIZE*12 + 1024 +
+				     SECTION_PADDING);
+    if ( !literals || !buffer ) {
+      fprintf(stderr,"lzss: memoria insuficiente\n");
+      exit(1);
+    }
+  }
+  for ( ; ; ) {
+    literal_count = get_varint();
+    sequence_count = get_varint();
+    if ( literal_count == 0 && sequence_count == 0 ) {
+      /* Punto de sincronizacin? */
+      if ( records || get_varint() == 0 )
+	break;
+      deliver_output();
+      continue;
+    }
+    literal_size = get_varint();
+    sequence_size = get_varint();
+    if ( literal_count > ENTROPY_BLOCK_SIZE ||
+	 sequence_count > ENTROPY_BLOCK_SIZE ||
+	 literal_size + sequence_size > ENTROPY_BLOCK_SIZE*12 + 1024 )
+      corrupt_stream();
+    read_section(buffer, literal_size + sequence_size);
+
+    /* Stream de smbolos. */
+    p = literals;
+    end = literals + literal_count;
+    if ( literal_count > 0 ) {
+      section = buffer;
+      section_end = buffer + literal_size;
+      section_bits = 0;
+      section_count = 0;
+      get_code(256, table[ 0 ]);
+      while ( end - p >= 10 ) {
+	refill_section();
+	for ( k = 0 ; k < 5 ; k++ ) {
+	  e = table[ 0 ][ section_bits & mask ];
+	  p[ 0 ] = ENTRY_SYMBOL_1(e);
+	  p[ 1 ] = ENTRY_SYMBOL_2(e);
+	  p += ENTRY_SYMBOLS(e);
+	  section_bits >>= ENTRY_LENGTH(e);
+	  section_count -= ENTRY_LENGTH(e);
+	}
+      }
+      while ( p < end ) {
+	refill_section();
+	e = table[ 0 ][ section_bits & mask ];
+	*p++ = ENTRY_SYMBOL_1(e);
+	section_bits >>= ENTRY_LENGTH_1(e);
+	section_count -= ENTRY_LENGTH_1(e);
+      }
+    }
+
+    /* Stream de secuencias. */
+    p = literals;
+    if ( sequence_count > 0 ) {
+      section = buffer + literal_size;
+      section_end = section + sequence_size;
+      section_bits = 0;
+      section_count = 0;
+      for ( k = 0 ; k < 3 ; k++ )
+	get_code(SLOTS, table[ k + 1 ]);
+      for ( s = 0 ; s < sequence_count ; s++ ) {
+	refill_section();
+	slot[ 0 ] = DECODE_SLOT(table[ 1 ]);
+	slot[ 1 ] = DECODE_SLOT(table[ 2 ]);
+	slot[ 2 ] = DECODE_SLOT(table[ 3 ]);
+	refill_section();
+	run = SLOT_VALUE(slot[ 0 ]);
+	length = SLOT_VALUE(slot[ 1 ]) + min_match_length;
+	distance = SLOT_VALUE(slot[ 2 ]) + 1;
+	if ( run > end - p || length > look_ahead_size ||
+	     distance > window_size )
+	  corrupt_stream();
+	memcpy(out, p, run);
+	out += run;
+	p += run;
+	copy_match(out, distance, length);
+	out += length;
+	if ( out >= limit )
+	  flush_output();
+      }
+    }
+    memcpy(out, p, end - p);
+    out += end - p;
+    if ( out >= limit )
+      flush_output();
+  }
+}
+
+/*
+ * Descompresin de BIT_FORMAT.
+ */
+static void decode_bits() {
+  int value;
+  int current_position;
+  int match_length;
+  int match_position;
+  int distance;
+
+  /* Posicin en la ventana del compresor del siguiente smbolo. */
+  current_position = 1;
+  for ( ; ; ) {
+    if ( sync_flush )
+      refill_token();
+    else
+      refill_bits();
+    if ( TAKE_BITS(1) ) {
+      /* Ledo 1, un-encoded "k". */
+      *out++ = (unsigned char) TAKE_BITS(8);
+      current_position = MOD_WINDOW( current_position + 1 );
+    } else {
+      /* Ledo 0, "ij" code. */
+      match_position = TAKE_BITS(index_size); /* "i" */
+      if ( match_position == END_OF_STREAM ) {
+	/* Punto de sincronizacin? */
+	if ( records || TAKE_BITS(length_size) == 0 )
+	  break;
+	align_bits();
+	deliver_output();
+	continue;
+      }
+      match_length = TAKE_BITS(length_size); /* "j" */
+      match_length += min_encoded_string_size + 1;
+      /* Copiamos a la salida "j" caracteres a partir de la posicin
+	 "i" del diccionario, que est "distance" smbolos atrs. */
+      distance = MOD_WINDOW( current_position - match_position );
+      if ( distance == 0 )
+	distance = window_size;
+      copy_match(out, distance, match_length);
+      out += match_length;
+      current_position = MOD_WINDOW( current_position + match_length );
+    }
+    if ( out >= limit )
+      flush_output();
+  }
+}
+
+static void decode_symbols() {
+  if ( format == BYTE_FORMAT )
+    decode_bytes();
+  else if ( format == ENTROPY_FORMAT )
+    decode_entropy();
+  else
+    decode_bits();
+}
+
+/*
+ * Realiza la descompresin del stream. La salida se genera en un
+ * buffer lineal que tambin hace de ventana: "output" contiene los
+ * window_size ltimos smbolos (inicialmente a 0, como la ventana del
+ * compresor) seguidos de los que an no se han escrito. Cuando estos
+ * llegan a "chunk" bytes se escriben de una vez y los window_size
+ * ltimos se desplazan al principio. Como un grupo de BYTE_FORMAT
+ * puede producir 8 cadenas antes de comprobarlo, se reserva espacio
+ * para ellas (y en ENTROPY_FORMAT, para los smbolos que siguen a la
+ * ltima secuencia de un bloque). El diccionario predefinido ocupa
+ * los ltimos smbolos de la ventana inicial.
+ */
+void decode_stream(int argc, char *argv[]) {
+  int i, j;
+  int value;
+  int header;
+  int chunk;
+  int slack;
+  int preset_flag = 0;
+  int records_flag = 0;
+  unsigned int checksum = 0;
+
+  parse_decoder_options(argc, argv);
+  /* Con "-f", el stream tiene al menos 4 bytes (o termina antes). */
+  if ( sync_flush )
+    need_input(4);
+  else
+    reload_input();
+  if ( input_end - in >= 4 && ( in[ 0 ] == 0x40 || in[ 0 ] == 0x20 ) &&
+       ( in[ 1 ] & ~( BYTE_HEADER_PRESET | BYTE_HEADER_RECORDS ) ) == 0 ) {
+    format = in[ 0 ] == 0x40 ? BYTE_FORMAT : ENTROPY_FORMAT;
+    preset_flag = in[ 1 ] & BYTE_HEADER_PRESET;
+    records_flag = in[ 1 ] & BYTE_HEADER_RECORDS;
+    index_size = in[ 2 ];
+    length_size = in[ 3 ];
+    in += 4;
+    check_sizes();
+    if ( preset_flag ) {
+      if ( sync_flush )
+	need_input(4);
+      for ( i = 0 ; i < 4 ; i++ )
+	checksum |= (unsigned int) in[ i ] << ( 8 * i );
+      in += 4;
+    }
+  } else {
+    for ( i = 0 ; i < 256 ; i++ )
+      for ( reversed[ i ] = 0, j = 0 ; j < 8 ; j++ )
+	if ( i & ( 1 << j ) )
+	  reversed[ i ] |= 0x80 >> j;
+    if ( sync_flush )
+      refill_token();
+    else
+      refill_bits();
+    header = (int) ( bits >> ( 64 - HEADER_SIZE ) );
+    if ( header != 0 && header < ( 1 << ( HEADER_SIZE - 1 ) ) ) {
+      SKIP_BITS(HEADER_SIZE);
+      preset_flag = header & HEADER_PRESET;
+      records_flag = header & HEADER_RECORDS;
+      index_size = ( header & ~HEADER_PRESET ) >> 6;
+      length_size = header & 31;
+      check_sizes();
+      for ( i = 0 ; preset_flag && i < 2 ; i++ ) {
+	if ( sync_flush )
+	  need_bits(16);
+	else
+	  refill_bits();
+	checksum = checksum << 16 | TAKE_BITS(16);
+      }
+    }
+  }
+  init_window(0);
+
+  chunk = window_size > ( 1 << 20 ) ? window_size : ( 1 << 20 );
+  slack = format == ENTROPY_FORMAT ?
+    ENTROPY_BLOCK_SIZE + look_ahead_size : 8*look_ahead_size;
+  output = (unsigned char *)calloc(window_size + chunk + slack + 16, 1);
+  if ( !output ) {
+    fprintf(stderr,"lzss: memoria insuficiente\n");
+    exit(1);
+  }
+  out = output + window_size;
+  written = out;
+  limit = out + chunk;
+  load_preset();
+  if ( preset_flag && !dictionary_name ) {
+    fprintf(stderr,"lzss: el stream usa un diccionario predefinido (-D)\n");
+    exit(1);
+  }
+  if ( !preset_flag && dictionary_name ) {
+    fprintf(stderr,"lzss: el stream no usa diccionario predefinido\n");
+    exit(1);
+  }
+  if ( preset_flag && checksum != preset_checksum ) {
+    fprintf(stderr,"lzss: el diccionario no es el del stream\n");
+    exit(1);
+  }
+  /* El modo registro lo decide el stream; "-r" slo se comprueba. */
+  if ( records && !records_flag ) {
+    fprintf(stderr,"lzss: el stream no est en modo registro (-r)\n");
+    exit(1);
+  }
+  if ( records_flag && sync_flush ) {
+    fprintf(stderr,"lzss: el modo registro no se combina con \"-f\"\n");
+    exit(1);
+  }
+  records = records_flag;
+  if ( preset_size > 0 )
+    memcpy(out - preset_size, preset, preset_size);
+
+  if ( !records ) {
+    decode_symbols();
+    flush_output();
+    free(output);
+    return;
+  }
+  /* Cada registro comienza en un lmite de byte. */
+  if ( format == BIT_FORMAT )
+    align_bits();
+  while ( more_input() ) {
+    decode_symbols();
+    if ( format == BIT_FORMAT )
+      align_bits();
+    write_record();
+  }
+  free(output);
 }
 
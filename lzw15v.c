@@ -13,25 +13,97 @@
 #include <stdlib.h>
 #include <string.h>
 #include "bitio.h"
+#include "dictionary.h"
+#include "lzw_dict.h"
 
 /*
- * Nmero mximo de bits de un cdigo de compresin "w".
+ * Uso:
+ *
+ * lzw15v e [-m variante] [-c bits_codigo] [-a] [-D diccionario] [-r] < entrada > salida
+ * lzw15v d [-D diccionario] [-r] < entrada > salida
+ *
+ * "-m" selecciona cmo crece el diccionario. Tras cada cadena "cur"
+ * (precedida de la cadena "prev"), "lzw" (por defecto) inserta "prev"
+ * seguida del primer smbolo de "cur"; "lzmw" (Miller y Wegman)
+ * inserta la concatenacin "prev""cur", y "lzap" (Storer) inserta
+ * "prev" seguida de cada prefijo de "cur". Las dos ltimas aprenden
+ * antes las cadenas largas que se repiten (p.e. las plantillas de un
+ * log), con lo que se emiten menos cdigos por byte de entrada.
+ * Ninguna cadena del diccionario puede superar max_code+1 smbolos.
+ *
+ * "-c" indica el nmero mximo de bits de un cdigo (de 12 a 24, o a
+ * 22 con "lzmw"; por defecto 15). Con ms bits el diccionario tarda ms en llenarse y
+ * vaciarse, lo que conviene con entradas grandes y homogneas.
+ *
+ * Por defecto el diccionario se vaca en cuanto se llena. Con "-a"
+ * (como en compress) el compresor lo conserva lleno, sin aadir ms
+ * cadenas, y cada CHECK_GAP smbolos de entrada calcula la tasa de
+ * compresin acumulada desde el ltimo vaciado; lo vaca en cuanto
+ * sta no mejora la del punto de control anterior. Ayuda cuando el
+ * diccionario completo sigue siendo til (p.e. logs con "-c 12"),
+ * pero tras un tramo de datos aleatorios conserva un diccionario que
+ * no sirve para lo que viene despus. El descompresor no necesita la
+ * opcin: nunca aade cadenas a un diccionario lleno.
+ *
+ * "-D" inicializa el diccionario de LZW con las cadenas de un
+ * diccionario predefinido (ver dict_train.c), lo que permite
+ * comprimir bien entradas pequeas. "-r" comprime cada lnea de la
+ * entrada (registro) de forma independiente: cada registro termina
+ * con END_OF_STREAM en un lmite de byte y el diccionario vuelve a su
+ * estado inicial entre registros. El descompresor necesita la
+ * opcin "-D" del compresor; el tamao del cdigo y el modo registro
+ * viajan en una cabecera.
+ *
+ * La cabecera es BUMP_CODE (9 bits), que nunca es el primer cdigo
+ * de un stream, seguido del nmero mximo de bits de un cdigo (5
+ * bits). Slo se escribe si ste no es el de por defecto o si se usa
+ * "-D" o "-r" (en ese caso siempre, y en modo registro seguida de un
+ * lmite de byte), de forma que sin opciones el stream es el clsico.
+ * Con "-m lzmw" o "-m lzap" la cabecera empieza por FLUSH_CODE (que
+ * tampoco puede ser el primer cdigo) y lleva adems la variante (2
+ * bits). Sigue un bit que indica si se ha usado un diccionario
+ * predefinido, seguido en ese caso de su resumen (32 bits, ver
+ * dictionary_checksum()), con el que el descompresor comprueba que
+ * tiene el mismo, y termina con un bit que indica el modo registro.
  */
-#define MAX_CODE_SIZE_IN_BITS 15
 
 /*
- * Valor mximo que puede tomar un cdigo de compresin.
+ * Nmero mximo de bits de un cdigo de compresin "w" por defecto,
+ * mnimo y mximo.
  */
-#define MAX_CODE ((1<<MAX_CODE_SIZE_IN_BITS)-1)
+#define MAX_CODE_SIZE_IN_BITS      15
+#define MIN_CODE_BITS              12
+#define MAX_CODE_BITS              LZW_MAX_CODE_BITS
+#define HEADER_CODE_BITS           5
+#define HEADER_VARIANT_BITS        2
 
 /*
- * Define el tamao del diccionario. Como se utiliza hashing y cuando
- * aparece una colisin se utiliza una bsqueda secuencial, interesa
- * utilizar un nmero primo suficientemente grande. A continuacin se
- * muestran algunas sugerencias prximas a potencias de dos:
- * 4999, 8999, 17989, 35023, 69997, 139999.
+ * Variantes de LZW (opcin "-m").
  */
-#define TABLE_SIZE                 35023L
+#define LZW                        0
+#define LZMW                       1
+#define LZAP                       2
+int variant = LZW;
+const char *variant_names[] = { "lzw", "lzmw", "lzap" };
+
+/*
+ * En LZMW el diccionario no contiene todos los prefijos de sus
+ * cadenas, pero el compresor los necesita para recorrerlo smbolo a
+ * smbolo. Los prefijos que no tienen cdigo son nodos internos, con
+ * identificadores a partir de max_code+1 y hasta
+ * 2^(max_code_bits+LZMW_EXTRA_BITS)-1, para los que el diccionario de
+ * lzw_dict.c se reserva ms grande. Si se agotan, las cadenas nuevas
+ * reciben cdigo pero no se insertan, lo que en la prctica congela
+ * el diccionario (con logs, mejor que vaciarlo).
+ */
+#define LZMW_EXTRA_BITS            2
+
+/*
+ * Nmero mximo de bits de un cdigo de compresin "w" (opcin "-c")
+ * y valor mximo que puede tomar un cdigo de compresin.
+ */
+int max_code_bits = MAX_CODE_SIZE_IN_BITS;
+unsigned int max_code;
 
 /*
  * Indica el fin de la compresin.
@@ -54,36 +126,76 @@
 #define FIRST_CODE                 259
 
 /*
- * Entrada vaca.
+ * Con "-a", distancia en smbolos de entrada entre los puntos de
+ * control una vez lleno el diccionario, y tasa de compresin (bytes
+ * de entrada por cada 256 bytes de salida, como en compress).
  */
-#define UNUSED                     -1
+#define CHECK_GAP                  10000
+#define RATIO(in, bits)            ( ( (in) << 11 ) / ( (bits) ? (bits) : 1 ) )
 
 /*
- * La siguiente estructura de datos declara (de forma esttica) el
- * diccionario. Como puede apreciarse, se trata de una tabla de ternas
- * "code_value", "parent_code" y "character", donde cada terna
- * especifica una cadena diferente. El campo "code_value" es el cdigo
- * de compresin asociado a la cadena "parent_code""character", es
- * decir, el ndice de la cadena "parent_code""character" en el
- * diccionario. Recuerdese adems que "code_value"s menores que 256
+ * Nmero mximo de bytes de un diccionario predefinido que se
+ * utilizan (los ltimos). Cada byte aade a lo sumo una cadena, por
+ * lo que al menos la mitad de los cdigos quedan libres para los
+ * datos.
+ */
+#define MAX_PRESET_SIZE ((int)(max_code+1)/2-FIRST_CODE)
+
+/*
+ * Longitud mxima de una cadena del diccionario (LZMW y LZAP; las de
+ * LZW nunca la alcanzan).
+ */
+#define MAX_STRING_LENGTH (max_code+1)
+
+/*
+ * El compresor busca las cadenas "wk" en el diccionario de
+ * lzw_dict.c. El descompresor slo necesita saber qu cadena
+ * "parent_code""suffix_code" representa cada cdigo, as que
+ * "strings" est indexada por cdigo. "suffix_code" es un smbolo
+ * ("k") salvo en LZMW, donde es el cdigo de la segunda cadena de la
+ * concatenacin. Recuerdese adems que los cdigos menores que 256
  * codifican smbolos (races).
+ *
+ * El descompresor guarda tambin la longitud de cada cadena y la
+ * posicin de la salida en la que se escribi por ltima vez (o -1),
+ * de forma que, mientras siga en "output_buffer", la cadena se copia
+ * de all con memcpy() en lugar de recorrer "parent_code" hasta la
+ * raz.
  */
-struct dictionary {
-    int code_value;
+struct string {
     int parent_code;
-    char k;
-} dict[TABLE_SIZE];
+    unsigned int suffix_code;
+    unsigned int length;
+    long position;
+} *strings;
 
 /*
- * Contiene la cadena "w" descodificada.
+ * Salida del descompresor. "output_buffer" contiene "output_count"
+ * bytes de la salida a partir de la posicin "output_base", de los
+ * que los "output_written" primeros ya se han escrito. Cuando se
+ * llena (llega a "output_size" bytes) se escribe y se conservan los
+ * ltimos "output_size"/2 bytes, que son los que ms probablemente
+ * contienen las cadenas que se van a repetir. Tiene espacio para una
+ * cadena de longitud mxima ms all de "output_size".
  */
-char decode_stack[TABLE_SIZE];
+#define OUTPUT_BUFFER_SIZE         (1 << 20)
+unsigned char *output_buffer;
+unsigned int output_size;
+unsigned int output_count;
+unsigned int output_written;
+long output_base;
 
 /*
  * Siguiente cdigo insertado en el diccionario.
  */
 unsigned int next_w;
 
+/*
+ * Siguiente nodo interno (LZMW) y cdigo que tiene cada uno (o -1).
+ */
+unsigned int next_node;
+int *node_code = NULL;
+
 /*
  * Tamao actual del cdigo de compresin.
  */
@@ -96,65 +208,270 @@ int current_code_bits;
 unsigned int next_bump_code;
 
 /*
- * Inicializa el diccionario y otras variables globales.
+ * Estado del diccionario tras insertar las cadenas del diccionario
+ * predefinido (o vaco, si no se usa). Las cadenas con cdigo menor
+ * que "preset_w" son permanentes (ver lzw_dict_freeze()).
+ */
+unsigned int preset_w;
+int preset_code_bits;
+unsigned int preset_bump_code;
+
+/*
+ * Opciones de la lnea de comandos.
+ */
+char *dictionary_name = NULL;
+int records = 0;
+int adaptive_reset = 0;
+
+/*
+ * Reserva e inicializa el diccionario y otras variables globales.
  */
 void InitializeDictionary()
 {
-    unsigned int i;
+    max_code = ( 1u << max_code_bits ) - 1;
+    lzw_dict_init(variant == LZMW ? max_code_bits + LZMW_EXTRA_BITS
+		  : max_code_bits);
+    next_w = preset_w = FIRST_CODE;
+    current_code_bits = preset_code_bits = 9;
+    next_bump_code = preset_bump_code = 511;
+}
 
-    for ( i = 0 ; i < TABLE_SIZE ; i++ )
-        dict[ i ].code_value = UNUSED;
-    next_w = FIRST_CODE;
-    current_code_bits = 9;
-    next_bump_code = 511;
+/*
+ * Vaca el diccionario, conservando las cadenas del diccionario
+ * predefinido.
+ */
+void ResetDictionary()
+{
+    lzw_dict_reset();
+    next_w = preset_w;
+    next_node = max_code + 1;
+    current_code_bits = preset_code_bits;
+    next_bump_code = preset_bump_code;
 }
 
 /*
- * Busca en el diccionario la cadena "wk". Se utiliza una funcin hash
- * que depende "w" y de "k", que se relacionan mediante la operacin
- * XOR. En caso de aparecer una colisin se busca, tantas veces como
- * sea necesario, en la entrada "index*2 mod TABLE_SIZE", donde
- * "index" el la posicin esperrada de la cadena "wk" en el
- * diccionario.
+ * Inserta en el diccionario las cadenas que encontrara el compresor
+ * al procesar el diccionario predefinido, sin generar cdigos. El
+ * estado resultante es el que restaura ResetDictionary().
  */
-unsigned int find_child_node(int parent_code, int child_k) {
-  unsigned int index;
-  unsigned int offset;
-  
-  index = ( child_k << ( MAX_CODE_SIZE_IN_BITS - 8 ) ) ^ parent_code;
-  if ( index == 0 )
-    offset = 1;
-  else
-    offset = TABLE_SIZE - index;
-  for ( ; ; ) {
-    if ( dict[ index ].code_value == UNUSED )
-      /* Entrada vaca. */
-      return index;
-    if ( dict[ index ].parent_code == parent_code &&
-	 dict[ index ].k == (char) child_k )
-      /* Cadena encontrada. */
-      return index;
-    /* Colisin. */
-    if ( (int) index >= offset )
-      index -= offset;
-    else
-      index += TABLE_SIZE - offset;
+void PresetDictionary(const unsigned char *data, int size) {
+  int k;
+  int w;
+  int i;
+  int code;
+
+  if ( size > MAX_PRESET_SIZE ) {
+    data += size - MAX_PRESET_SIZE;
+    size = MAX_PRESET_SIZE;
+  }
+  if ( size > 0 ) {
+    w = data[ 0 ];
+    for ( i = 1 ; i < size ; i++ ) {
+      k = data[ i ];
+      code = lzw_dict_find(LZW_KEY(w, k));
+      if ( code >= 0 )
+	w = code;
+      else {
+	lzw_dict_add(LZW_KEY(w, k), next_w++);
+	w = k;
+	if ( next_w > next_bump_code ) {
+	  current_code_bits++;
+	  next_bump_code <<= 1;
+	  next_bump_code |= 1;
+	}
+      }
+    }
+  }
+  lzw_dict_freeze();
+  preset_w = next_w;
+  preset_code_bits = current_code_bits;
+  preset_bump_code = next_bump_code;
+}
+
+void parse_options(int argc, char *argv[]) {
+  int i;
+  for ( i = 2 ; i < argc ; i++ ) {
+    if ( strcmp(argv[ i ], "-c") == 0 && i + 1 < argc )
+      max_code_bits = atoi(argv[ ++i ]);
+    else if ( strcmp(argv[ i ], "-D") == 0 && i + 1 < argc )
+      dictionary_name = argv[ ++i ];
+    else if ( strcmp(argv[ i ], "-r") == 0 )
+      records = 1;
+    else if ( strcmp(argv[ i ], "-a") == 0 )
+      adaptive_reset = 1;
+    else if ( strcmp(argv[ i ], "-m") == 0 && i + 1 < argc ) {
+      i++;
+      for ( variant = LZAP ; variant > LZW ; variant-- )
+	if ( strcmp(argv[ i ], variant_names[ variant ]) == 0 )
+	  break;
+      if ( strcmp(argv[ i ], variant_names[ variant ]) != 0 ) {
+	fprintf(stderr, "lzw15v: variante desconocida: %s\n", argv[ i ]);
+	exit(1);
+      }
+    }
   }
 }
 
 /*
- * This routine decodes a string from the dictionary, and stores it
- * in the decode_stack data structure.  It returns a count to the
- * calling program of how many characters were placed in the stack.
+ * Comprueba el nmero mximo de bits de un cdigo.
  */
+void check_code_bits() {
+  int max_bits = variant == LZMW ? MAX_CODE_BITS - LZMW_EXTRA_BITS
+    : MAX_CODE_BITS;
 
-unsigned int string(unsigned int count, unsigned int w) {
-  while ( w > 255 ) {
-    decode_stack[ count++ ] = dict[ w ].k;
-    w = dict[ w ].parent_code;
+  if ( max_code_bits < MIN_CODE_BITS || max_code_bits > max_bits ) {
+    fprintf(stderr, "lzw15v: -c %d fuera de rango (de %d a %d)\n",
+	    max_code_bits, MIN_CODE_BITS, max_bits);
+    exit(1);
+  }
+}
+
+/*
+ * Indica si el stream lleva cabecera (ver el comienzo del fichero).
+ * El descompresor, sin "-D" ni "-r", la reconoce por su primer
+ * cdigo.
+ */
+int has_header() {
+  return max_code_bits != MAX_CODE_SIZE_IN_BITS || dictionary_name ||
+    records || variant != LZW;
+}
+
+/*
+ * Resumen del diccionario predefinido que viaja en la cabecera.
+ */
+unsigned int preset_checksum() {
+  unsigned char *data;
+  int size;
+  unsigned int checksum;
+
+  data = read_dictionary(dictionary_name, &size);
+  checksum = dictionary_checksum(data, size);
+  free(data);
+  return checksum;
+}
+
+void write_header() {
+  unsigned int checksum;
+
+  put_bits(variant == LZW ? BUMP_CODE : FLUSH_CODE, 9);
+  put_bits(max_code_bits, HEADER_CODE_BITS);
+  if ( variant != LZW )
+    put_bits(variant, HEADER_VARIANT_BITS);
+  put_bits(dictionary_name != NULL, 1);
+  if ( dictionary_name ) {
+    checksum = preset_checksum();
+    put_bits(checksum >> 16, 16);
+    put_bits(checksum & 0xFFFF, 16);
+  }
+  put_bits(records, 1);
+  if ( records )
+    align_output();
+}
+
+void read_header() {
+  unsigned int code;
+  unsigned int checksum;
+
+  if ( !dictionary_name && peek_bits(9) != BUMP_CODE &&
+       peek_bits(9) != FLUSH_CODE ) {
+    if ( records ) {
+      fprintf(stderr, "lzw15v: el stream no est en modo registro (-r)\n");
+      exit(1);
+    }
+    return;
+  }
+  code = get_bits(9);
+  if ( code != BUMP_CODE && code != FLUSH_CODE ) {
+    fprintf(stderr, "lzw15v: cabecera incorrecta\n");
+    exit(1);
+  }
+  max_code_bits = get_bits(HEADER_CODE_BITS);
+  if ( code == FLUSH_CODE ) {
+    variant = get_bits(HEADER_VARIANT_BITS);
+    if ( variant != LZMW && variant != LZAP ) {
+      fprintf(stderr, "lzw15v: cabecera incorrecta\n");
+      exit(1);
+    }
+  }
+  check_code_bits();
+  if ( get_bits(1) ) {
+    checksum = (unsigned int) get_bits(16) << 16;
+    checksum |= get_bits(16);
+    if ( !dictionary_name ) {
+      fprintf(stderr, "lzw15v: el stream usa un diccionario predefinido (-D)\n");
+      exit(1);
+    }
+    if ( checksum != preset_checksum() ) {
+      fprintf(stderr, "lzw15v: el diccionario no es el del stream\n");
+      exit(1);
+    }
+  } else if ( dictionary_name ) {
+    fprintf(stderr, "lzw15v: el stream no usa diccionario predefinido\n");
+    exit(1);
+  }
+  /* El modo registro lo decide el stream; "-r" slo se comprueba. */
+  if ( get_bits(1) )
+    records = 1;
+  else if ( records ) {
+    fprintf(stderr, "lzw15v: el stream no est en modo registro (-r)\n");
+    exit(1);
+  }
+  if ( records )
+    align_input();
+}
+
+/*
+ * Inicializa el diccionario, con el diccionario predefinido si se ha
+ * indicado uno.
+ */
+void load_dictionary() {
+  unsigned char *data;
+  int size;
+
+  InitializeDictionary();
+  if ( dictionary_name ) {
+    data = read_dictionary(dictionary_name, &size);
+    PresetDictionary(data, size);
+    free(data);
   }
-  decode_stack[ count++ ] = (char) w;
-  return( count );
+}
+
+/*
+ * En modo registro, la entrada se lee lnea a lnea en
+ * "record". next_symbol() devuelve los smbolos del registro actual
+ * (o de la entrada completa, fuera de ese modo) y EOF al final.
+ */
+unsigned char *record = NULL;
+int record_size = 0;
+int record_length = 0;
+int record_position = 0;
+
+int read_record() {
+  int c;
+
+  record_length = record_position = 0;
+  while ( ( c = getchar() ) != EOF ) {
+    if ( record_length == record_size ) {
+      record_size = record_size ? 2 * record_size : 4096;
+      record = (unsigned char *) realloc(record, record_size);
+      if ( !record ) {
+	fprintf(stderr, "lzw15v: memoria insuficiente\n");
+	exit(1);
+      }
+    }
+    record[ record_length++ ] = (unsigned char) c;
+    if ( c == '\n' )
+      break;
+  }
+  return record_length;
+}
+
+int next_symbol() {
+  if ( !records )
+    return getchar();
+  if ( record_position == record_length )
+    return EOF;
+  return record[ record_position++ ];
 }
 
 /*
@@ -168,55 +485,364 @@ unsigned int string(unsigned int count, unsigned int w) {
  * encoder needs to check the codes for boundary conditions.
  */
 
-void encode_stream(int argc, char *argv[]) {
+/*
+ * Con "-a", smbolos de entrada y bits de salida desde el ltimo
+ * vaciado del diccionario, siguiente punto de control y mejor tasa de
+ * compresin en un punto de control.
+ */
+unsigned long in_count;
+unsigned long out_bits;
+unsigned long checkpoint;
+unsigned long best_ratio;
+
+/*
+ * Empieza a contar la tasa de compresin tras vaciar el diccionario.
+ */
+void reset_ratio() {
+  in_count = out_bits = 0;
+  best_ratio = 0;
+}
+
+/*
+ * Escribe el cdigo "w". Con el diccionario lleno (slo con "-a") lo
+ * vaca si en el ltimo punto de control la tasa de compresin
+ * acumulada ha cado por debajo de la mejor de los anteriores.
+ * Devuelve 1 si el diccionario est lleno o se ha vaciado, es decir,
+ * si no hay que insertar ninguna cadena.
+ */
+int put_code(unsigned int w) {
+  unsigned long ratio;
+
+  put_bits(w, current_code_bits);
+  out_bits += current_code_bits;
+  if ( next_w <= max_code )
+    return 0;
+  if ( in_count >= checkpoint ) {
+    checkpoint = in_count + CHECK_GAP;
+    ratio = RATIO(in_count, out_bits);
+    if ( ratio > best_ratio )
+      best_ratio = ratio;
+    else {
+      put_bits(FLUSH_CODE, current_code_bits);
+      ResetDictionary();
+      reset_ratio();
+    }
+  }
+  return 1;
+}
+
+/*
+ * Asigna el cdigo "next_w" a la cadena que se acaba de insertar. Si
+ * el diccionario se llena lo vaca (salvo con "-a", que lo conserva)
+ * y devuelve 1; si no, aumenta cuando toca el tamao del cdigo.
+ */
+int new_code() {
+  next_w++;
+  if ( next_w > max_code ) {
+    if ( adaptive_reset )
+      /* El primer punto de control, CHECK_GAP smbolos despus. */
+      checkpoint = in_count + CHECK_GAP;
+    else {
+      /* Vaciamos el diccionario. */
+      put_bits(FLUSH_CODE, current_code_bits);
+      ResetDictionary();
+    }
+    return 1;
+  }
+  if ( next_w > next_bump_code ) {
+    /* Aumentamos el tamao del cdigo en 1 bit. */
+    put_bits(BUMP_CODE, current_code_bits);
+    current_code_bits++;
+    next_bump_code <<= 1;
+    next_bump_code |= 1;
+  }
+  return 0;
+}
+
+void encode_symbols() {
   int k;
   int w;
-  unsigned int index;
+  int code;
+  unsigned int key;
   
-  InitializeDictionary();
-  if ((w=getchar())==EOF)
+  ResetDictionary();
+  reset_ratio();
+  if ((w=next_symbol())==EOF)
     /* Fichero de entrada vaco! */
     w = END_OF_STREAM;
-  while ((k=getchar())!=EOF) {
+  while ((k=next_symbol())!=EOF) {
+    in_count++;
     /* Buscamos "wk" en el diccionario. */
-    index = find_child_node(w, k);
+    key = LZW_KEY(w, k);
+    code = lzw_dict_find(key);
 
-    if ( dict[ index ].code_value != - 1 )
+    if ( code >= 0 )
       /* "wk" est en el diccionario. */
 
-      /* w <- direccin de "wk". */
-      w = dict[ index ].code_value;
+      /* w <- cdigo de "wk". */
+      w = code;
     else {
       /* "wk" no est en el diccionario. */
 
       /* Escribimos "w" a la salida. */
-      put_bits(w, current_code_bits);
-
-      /* Insertamos "wk" en el diccionario. */
-      dict[ index ].code_value = next_w++;
-      dict[ index ].parent_code = w;
-      dict[ index ].k = (char) k;
+      if ( !put_code(w) ) {
+	/* Insertamos "wk" en el diccionario. */
+	lzw_dict_add(key, next_w);
+	new_code();
+      }
 
       /* w <- k. */
       w = k;
-
-      if (next_w > MAX_CODE) {
-	/* Vaciamos el diccionario. */
-	put_bits(FLUSH_CODE, current_code_bits);
-	InitializeDictionary();
-      } else if (next_w > next_bump_code) {
-	/* Aumentamos el tamao del cdigo en 1 bit. */
-	put_bits(BUMP_CODE, current_code_bits);
-	current_code_bits++;
-	next_bump_code <<= 1;
-	next_bump_code |= 1;
-      }
     }
   }
   /* EOS. */
   put_bits(w, current_code_bits);
   put_bits(END_OF_STREAM, current_code_bits);
-  flush();
+}
+
+/*
+ * Ventana de entrada de LZMW y LZAP, que necesitan ver la cadena
+ * completa antes de saber cul es la ms larga del diccionario:
+ * "lookahead[lookahead_start..lookahead_end-1]" son los smbolos an
+ * no comprimidos.
+ */
+unsigned char *lookahead = NULL;
+unsigned int lookahead_start;
+unsigned int lookahead_end;
+int lookahead_eof;
+
+/*
+ * Rellena la ventana hasta tener al menos MAX_STRING_LENGTH smbolos
+ * (o hasta el final de la entrada).
+ */
+void fill_lookahead() {
+  int c;
+
+  if ( lookahead_eof ||
+       lookahead_end - lookahead_start >= MAX_STRING_LENGTH )
+    return;
+  memmove(lookahead, lookahead + lookahead_start,
+	  lookahead_end - lookahead_start);
+  lookahead_end -= lookahead_start;
+  lookahead_start = 0;
+  while ( lookahead_end < 2 * MAX_STRING_LENGTH ) {
+    if ( ( c = next_symbol() ) == EOF ) {
+      lookahead_eof = 1;
+      break;
+    }
+    lookahead[ lookahead_end++ ] = (unsigned char) c;
+  }
+}
+
+/*
+ * Inserta en el diccionario la cadena que representa el nodo "node"
+ * (un cdigo, o un nodo interno en LZMW), de longitud "length",
+ * seguida de "cur[0..cur_length-1]": en LZMW slo la concatenacin
+ * completa y en LZAP tambin cada prefijo. Como el descompresor no
+ * sabe si una cadena ya estaba en el diccionario, se le asigna un
+ * cdigo aunque as sea. Devuelve 1 si el diccionario se ha llenado.
+ */
+int add_strings(unsigned int node, unsigned int length,
+		const unsigned char *cur, unsigned int cur_length) {
+  unsigned int key;
+  unsigned int i;
+  int code;
+
+  /* Como el descompresor, LZMW slo inserta la concatenacin si cabe
+     entera; hay que comprobarlo antes de crear nodos o cdigos. */
+  if ( variant == LZMW && length + cur_length > MAX_STRING_LENGTH )
+    return 0;
+  for ( i = 0 ; i < cur_length ; i++ ) {
+    if ( ++length > MAX_STRING_LENGTH )
+      return 0;
+    key = LZW_KEY(node, cur[ i ]);
+    code = lzw_dict_find(key);
+    if ( variant == LZMW && i < cur_length - 1 ) {
+      /* Prefijo de la concatenacin: nodo interno. */
+      if ( code < 0 ) {
+	if ( next_node >> ( max_code_bits + LZMW_EXTRA_BITS ) )
+	  /* No quedan nodos internos: la cadena no se inserta. */
+	  return new_code();
+	lzw_dict_add(key, next_node);
+	node_code[ next_node - max_code - 1 ] = -1;
+	code = next_node++;
+      }
+      node = code;
+      continue;
+    }
+    if ( code < 0 ) {
+      lzw_dict_add(key, next_w);
+      code = next_w;
+    } else if ( code > (int) max_code &&
+		node_code[ code - max_code - 1 ] < 0 )
+      /* Un nodo interno pasa a ser una cadena. */
+      node_code[ code - max_code - 1 ] = next_w;
+    node = code;
+    if ( new_code() )
+      return 1;
+  }
+  return 0;
+}
+
+/*
+ * Compresor de LZMW y LZAP. Busca la cadena ms larga del diccionario
+ * que empieza en la ventana, la escribe y despus inserta las cadenas
+ * que forma con la anterior. A diferencia de LZW, el descompresor
+ * conoce todas las cadenas insertadas antes de leer el siguiente
+ * cdigo.
+ */
+void encode_phrases() {
+  unsigned int node;
+  unsigned int length;
+  unsigned int available;
+  unsigned int best_node = 0;
+  unsigned int best_length = 0;
+  int best_code = 0;
+  int code;
+  int prev = 0;
+  unsigned int prev_node = 0;
+  unsigned int prev_length = 0;
+
+  if ( !lookahead ) {
+    lookahead = (unsigned char *) malloc(2 * MAX_STRING_LENGTH);
+    if ( variant == LZMW )
+      node_code = (int *) malloc(( ( 1u << ( max_code_bits + LZMW_EXTRA_BITS ) )
+				   - max_code - 1 ) * sizeof(int));
+    if ( !lookahead || ( variant == LZMW && !node_code ) ) {
+      fprintf(stderr, "lzw15v: memoria insuficiente\n");
+      exit(1);
+    }
+  }
+  lookahead_start = lookahead_end = 0;
+  lookahead_eof = 0;
+  ResetDictionary();
+  reset_ratio();
+  for ( ; ; ) {
+    fill_lookahead();
+    available = lookahead_end - lookahead_start;
+    if ( available == 0 )
+      break;
+    /* Cadena ms larga del diccionario. */
+    node = best_node = best_code = lookahead[ lookahead_start ];
+    length = best_length = 1;
+    while ( length < available ) {
+      code = lzw_dict_find(LZW_KEY(node, lookahead[ lookahead_start + length ]));
+      if ( code < 0 )
+	break;
+      node = code;
+      length++;
+      if ( node > max_code )
+	code = node_code[ node - max_code - 1 ];
+      if ( code >= 0 ) {
+	best_node = node;
+	best_code = code;
+	best_length = length;
+      }
+    }
+    /* La escribimos y, si es posible, insertamos "prev""cur". */
+    in_count += best_length;
+    if ( put_code(best_code) )
+      prev = 0;
+    else if ( prev &&
+	      add_strings(prev_node, prev_length,
+			  lookahead + lookahead_start, best_length) )
+      prev = 0;
+    else {
+      prev = 1;
+      prev_node = best_node;
+      prev_length = best_length;
+    }
+    lookahead_start += best_length;
+  }
+  put_bits(END_OF_STREAM, current_code_bits);
+}
+
+void encode_stream(int argc, char *argv[]) {
+  parse_options(argc, argv);
+  check_code_bits();
+  if ( has_header() )
+    write_header();
+  load_dictionary();
+  if ( !records ) {
+    if ( variant == LZW )
+      encode_symbols();
+    else
+      encode_phrases();
+    flush();
+    return;
+  }
+  /* Cada registro es un stream independiente que termina en un
+     lmite de byte. */
+  while ( read_record() > 0 ) {
+    if ( variant == LZW )
+      encode_symbols();
+    else
+      encode_phrases();
+    align_output();
+  }
+}
+
+/*
+ * Escribe en la salida el contenido pendiente de "output_buffer" y, si
+ * est lleno, desplaza su segunda mitad al principio.
+ */
+void flush_output() {
+  unsigned int keep = output_size / 2;
+
+  fwrite(output_buffer + output_written, 1,
+	 output_count - output_written, stdout);
+  if ( output_count >= output_size ) {
+    memmove(output_buffer, output_buffer + output_count - keep, keep);
+    output_base += output_count - keep;
+    output_count = keep;
+  }
+  output_written = output_count;
+}
+
+/*
+ * Escribe string(w) de forma que termine justo antes de "end",
+ * recorriendo el diccionario desde el final de la cadena hacia su
+ * raz, y devuelve dnde empieza.
+ */
+unsigned char *write_string(unsigned int w, unsigned char *end) {
+  while ( w > 255 ) {
+    if ( strings[ w ].suffix_code > 255 )
+      /* LZMW. */
+      end = write_string(strings[ w ].suffix_code, end);
+    else
+      *--end = (unsigned char) strings[ w ].suffix_code;
+    w = strings[ w ].parent_code;
+  }
+  *--end = (unsigned char) w;
+  return end;
+}
+
+/*
+ * Escribe string(w) directamente en su posicin de "output_buffer" y
+ * devuelve su primer smbolo. Si la ltima aparicin de string(w)
+ * sigue en el buffer se copia; si no, se reconstruye con
+ * write_string().
+ */
+int put_string(unsigned int w) {
+  unsigned char *p;
+
+  if ( output_count >= output_size )
+    flush_output();
+  p = output_buffer + output_count;
+  if ( w < 256 ) {
+    *p = (unsigned char) w;
+    output_count++;
+    return w;
+  }
+  if ( strings[ w ].position >= output_base )
+    memcpy(p, output_buffer + ( strings[ w ].position - output_base ),
+	   strings[ w ].length);
+  else
+    write_string(w, p + strings[ w ].length);
+  /* La prxima vez se copia desde aqu. */
+  strings[ w ].position = output_base + output_count;
+  output_count += strings[ w ].length;
+  return *p;
 }
 
 /*
@@ -229,22 +855,27 @@ void encode_stream(int argc, char *argv[]) {
  * input codes are handled in various ways.
  */
 
-void decode_stream(int argc, char *argv[]) {
+void decode_symbols() {
   unsigned int w;
   unsigned int prev_w;
   int k;
-  unsigned int count;
+  long position;
+  long prev_position;
+  unsigned int length;
+  unsigned int parent;
+  unsigned char *cur;
   
   for ( ; ; ) {
-    InitializeDictionary();
-    /* prev_w <- primer cdigo de entrada. */
+    ResetDictionary();
+    /* prev_w <- primer cdigo de entrada, que puede ser una cadena
+       del diccionario predefinido. */
     prev_w = get_bits(current_code_bits);
     if ( prev_w == END_OF_STREAM )
       return;
-    /* Escribimos prev_w a la salida. */
-    putchar(prev_w);
-    /* k <- prev_w. */
-    k = prev_w;
+    /* Escribimos string(prev_w) a la salida y k <- su primer
+       smbolo. */
+    prev_position = output_base + output_count;
+    k = put_string(prev_w);
     for ( ; ; ) {
       /* w <- siguiente cdido de entrada. */
       w = get_bits(current_code_bits);
@@ -257,26 +888,113 @@ void decode_stream(int argc, char *argv[]) {
 	current_code_bits++;
 	continue;
       }
+      position = output_base + output_count;
+      if ( variant != LZW ) {
+	/* Escribir string(w) a la salida e insertar las cadenas que
+	   forma con string(prev_w) (ver add_strings()), que se acaba
+	   de escribir delante. */
+	put_string(w);
+	length = strings[ prev_w ].length;
+	if ( variant == LZMW ) {
+	  length += strings[ w ].length;
+	  if ( next_w <= max_code && length <= MAX_STRING_LENGTH ) {
+	    strings[ next_w ].parent_code = prev_w;
+	    strings[ next_w ].suffix_code = w;
+	    strings[ next_w ].length = length;
+	    strings[ next_w ].position = prev_position;
+	    next_w++;
+	  }
+	} else {
+	  cur = output_buffer + output_count - strings[ w ].length;
+	  parent = prev_w;
+	  for ( ; cur < output_buffer + output_count ; cur++ ) {
+	    if ( next_w > max_code || ++length > MAX_STRING_LENGTH )
+	      break;
+	    strings[ next_w ].parent_code = parent;
+	    strings[ next_w ].suffix_code = *cur;
+	    strings[ next_w ].length = length;
+	    strings[ next_w ].position = prev_position;
+	    parent = next_w++;
+	  }
+	}
+	prev_w = w;
+	prev_position = position;
+	continue;
+      }
       if ( w >= next_w ) {
 	/* Si w no est en el diccionario. */
-	/* Escribir string(w)+k a la salida. */
-	decode_stack[ 0 ] = (char) k;
-	count = string( 1, prev_w );
+	/* Escribir string(prev_w)+k a la salida. */
+	put_string(prev_w);
+	output_buffer[ output_count++ ] = (unsigned char) k;
       }
       else
 	/* Si w est en el diccionario. */
-	/* Escribir string(w) a la salida. */
-	count = string( 0, w );
-      /* k <- primer smbolo emitido en la salida anterior. */
-      k = decode_stack[ count - 1 ];
-      while ( count > 0 )
-	putchar(decode_stack[--count]);
-      /* Insertar wk en el diccionario. */
-      dict[ next_w ].parent_code = prev_w;
-      dict[ next_w ].k = (char) k;
-      next_w++;
+	/* Escribir string(w) a la salida y k <- su primer
+	   smbolo. */
+	k = put_string(w);
+      /* Insertar wk en el diccionario, si no est lleno (ver "-a").
+	 string(prev_w)+k es lo que se acaba de escribir a partir de
+	 string(prev_w). */
+      if ( next_w <= max_code ) {
+	strings[ next_w ].parent_code = prev_w;
+	strings[ next_w ].suffix_code = k;
+	strings[ next_w ].length = strings[ prev_w ].length + 1;
+	strings[ next_w ].position = prev_position;
+	next_w++;
+      }
       /* prev_w <- w. */
       prev_w = w;
+      prev_position = position;
     }
   }
 }
+
+/*
+ * Copia una cadena del diccionario predefinido en "strings".
+ */
+void set_string(unsigned int key, unsigned int code) {
+  strings[ code ].parent_code = LZW_KEY_PREFIX(key);
+  strings[ code ].suffix_code = LZW_KEY_SYMBOL(key);
+  strings[ code ].position = -1;
+}
+
+void decode_stream(int argc, char *argv[]) {
+  int c;
+  unsigned int w;
+
+  parse_options(argc, argv);
+  max_code_bits = MAX_CODE_SIZE_IN_BITS;
+  variant = LZW;
+  read_header();
+  load_dictionary();
+  strings = (struct string *) malloc(( max_code + 1 ) * sizeof(struct string));
+  /* Con diccionarios grandes las cadenas se repiten ms lejos. */
+  output_size = OUTPUT_BUFFER_SIZE;
+  while ( output_size < 4 * ( max_code + 1 ) )
+    output_size <<= 1;
+  output_buffer = (unsigned char *) malloc(output_size + max_code + 1);
+  if ( !strings || !output_buffer ) {
+    fprintf(stderr, "lzw15v: memoria insuficiente\n");
+    exit(1);
+  }
+  /* El descompresor indexa el diccionario por cdigo. El prefijo de
+     una cadena del diccionario predefinido tiene un cdigo menor. */
+  lzw_dict_walk(set_string);
+  for ( w = 0 ; w < 256 ; w++ )
+    strings[ w ].length = 1;
+  for ( w = FIRST_CODE ; w < preset_w ; w++ )
+    strings[ w ].length = strings[ strings[ w ].parent_code ].length + 1;
+  if ( !records ) {
+    decode_symbols();
+    flush_output();
+    return;
+  }
+  for ( ; ; ) {
+    if ( ( c = getchar() ) == EOF )
+      return;
+    ungetc(c, stdin);
+    decode_symbols();
+    flush_output();
+    align_input();
+  }
+}
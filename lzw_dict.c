@@ -0,0 +1,127 @@
+/*
+ * lzw_dict.c
+ *
+ * Diccionario del compresor LZW (ver lzw15v.c), que hace una bsqueda
+ * por cada smbolo de la entrada.
+ *
+ * Es una tabla hash con direccionamiento abierto y exploracin lineal
+ * de 2^(code_bits+1) entradas, por lo que el diccionario lleno ocupa
+ * como mucho la mitad de la tabla. Cada entrada (LZW_ENTRY) guarda la
+ * clave "wk" en un entero de 32 bits, de modo que comparar una cadena
+ * es una sola comparacin, y junto a ella el cdigo: una colisin
+ * cuesta leer la entrada siguiente, que casi siempre est en la misma
+ * lnea de cach.
+ *
+ * Para vaciar el diccionario no se recorre la tabla: cada entrada
+ * lleva la generacin en la que se insert, y lzw_dict_reset() pasa a
+ * la siguiente, con lo que las entradas anteriores cuentan como
+ * libres. La generacin FREE indica una entrada que nunca se ha
+ * usado, y PERMANENT una que no se borra nunca (las que
+ * lzw_dict_freeze() conserva, p. ej. las de un diccionario
+ * predefinido). Slo cuando se agotan las generaciones (cada 254
+ * vaciados) se borran de verdad las entradas.
+ *
+ * Que una cadena se encuentre aunque haya entradas libres de otras
+ * generaciones delante no es un problema: al insertarla, todas las
+ * entradas entre su posicin y la que le corresponde por su clave
+ * eran de la generacin actual (o permanentes), y lo siguen siendo
+ * hasta el siguiente vaciado.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lzw_dict.h"
+
+#define FREE 0
+#define PERMANENT 1
+#define FIRST_GENERATION 2
+#define LAST_GENERATION 255
+
+#define ENTRY_GENERATION(e) ( (e)->value >> 24 )
+#define ENTRY_CODE(e) ( (e)->value & 0xFFFFFF )
+
+static LZW_ENTRY *table;
+static unsigned int mask;
+static int shift;
+static unsigned int generation;
+
+/* Entrada en la que lzw_dict_add() inserta la ltima cadena que
+   lzw_dict_find() no ha encontrado. */
+static LZW_ENTRY *free_entry;
+
+/* Hash multiplicativo (Knuth): los bits altos del producto dependen
+   de todos los bits de la clave. */
+#define HASH(key) ( ( (key) * 2654435761u ) >> shift )
+
+/* Reserva un diccionario vaco para cdigos de hasta "code_bits"
+   bits. */
+void lzw_dict_init(int code_bits) {
+  int table_bits = code_bits + 1;
+  free(table);
+  table = (LZW_ENTRY *) calloc((size_t) 1 << table_bits, sizeof(LZW_ENTRY));
+  if ( !table ) {
+    fprintf(stderr, "lzw_dict: memoria insuficiente\n");
+    exit(1);
+  }
+  mask = ( 1u << table_bits ) - 1;
+  shift = 32 - table_bits;
+  generation = FIRST_GENERATION;
+}
+
+/* Devuelve el cdigo de la cadena "key", o -1 si no est en el
+   diccionario. */
+int lzw_dict_find(unsigned int key) {
+  LZW_ENTRY *e;
+  unsigned int i = HASH(key);
+  unsigned int g;
+  for ( ; ; ) {
+    e = &table[ i ];
+    g = ENTRY_GENERATION(e);
+    if ( g != generation && g != PERMANENT ) {
+      free_entry = e;
+      return -1;
+    }
+    if ( e->key == key )
+      return ENTRY_CODE(e);
+    i = ( i + 1 ) & mask;
+  }
+}
+
+/* Inserta la cadena "key", que lzw_dict_find() acaba de buscar sin
+   encontrarla, con el cdigo "code". */
+void lzw_dict_add(unsigned int key, unsigned int code) {
+  free_entry->key = key;
+  free_entry->value = generation << 24 | code;
+}
+
+/* Vaca el diccionario, conservando las entradas permanentes. */
+void lzw_dict_reset() {
+  unsigned int i;
+  if ( generation == LAST_GENERATION ) {
+    for ( i = 0 ; i <= mask ; i++ )
+      if ( ENTRY_GENERATION(&table[ i ]) != PERMANENT )
+	table[ i ].value = FREE;
+    generation = FIRST_GENERATION - 1;
+  }
+  generation++;
+}
+
+/* Hace permanentes las entradas de la generacin actual. */
+void lzw_dict_freeze() {
+  unsigned int i;
+  for ( i = 0 ; i <= mask ; i++ )
+    if ( ENTRY_GENERATION(&table[ i ]) == generation )
+      table[ i ].value = PERMANENT << 24 | ENTRY_CODE(&table[ i ]);
+}
+
+/* Llama a "visit" con cada cadena del diccionario. */
+void lzw_dict_walk(void (*visit)(unsigned int key, unsigned int code)) {
+  unsigned int i;
+  unsigned int g;
+  for ( i = 0 ; i <= mask ; i++ ) {
+    g = ENTRY_GENERATION(&table[ i ]);
+    if ( g == generation || g == PERMANENT )
+      visit(table[ i ].key, ENTRY_CODE(&table[ i ]));
+  }
+}
@@ -0,0 +1,30 @@
+/*
+ * lzw_dict.h
+ *
+ * Diccionario del compresor LZW: asocia a cada cadena "wk" (el cdigo
+ * "w" de su prefijo seguido del smbolo "k") su cdigo.
+ */
+
+/*
+ * Cada entrada ocupa 8 bytes: la clave "wk" empaquetada en 32 bits y
+ * el cdigo, cuyos 8 bits altos indican a qu generacin del
+ * diccionario pertenece la entrada (ver lzw_dict.c).
+ */
+typedef struct lzw_entry {
+  unsigned int key;
+  unsigned int value;
+} LZW_ENTRY;
+
+/* Nmero mximo de bits de un cdigo. */
+#define LZW_MAX_CODE_BITS 24
+
+#define LZW_KEY(w, k) ( ( (unsigned int) (w) << 8 ) | (unsigned char) (k) )
+#define LZW_KEY_PREFIX(key) ( (key) >> 8 )
+#define LZW_KEY_SYMBOL(key) ( (key) & 0xFF )
+
+void lzw_dict_init(int code_bits);
+int  lzw_dict_find(unsigned int key);
+void lzw_dict_add(unsigned int key, unsigned int code);
+void lzw_dict_reset();
+void lzw_dict_freeze();
+void lzw_dict_walk(void (*visit)(unsigned int key, unsigned int code));
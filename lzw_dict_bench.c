@@ -0,0 +1,222 @@
+/*
+ * lzw_dict_bench.c
+ *
+ * Mide las bsquedas por segundo del diccionario de LZW
+ * (lzw_dict.c) frente a la tabla que usaba antes lzw15v.c (entradas
+ * de 16 bytes con hash doble), recorriendo los datos como el
+ * compresor: una bsqueda por smbolo y una insercin por cdigo.
+ *
+ * Uso:
+ *
+ * lzw_dict_bench [megabytes [bits_codigo]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lzw_dict.h"
+
+#define REPETITIONS 5
+#define FIRST_CODE 259
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* La tabla de referencia: un nmero primo de entradas (el primero
+   mayor que 5/4 del nmero de cdigos) y, tras una colisin, saltos
+   de "table_size - index" posiciones. */
+static struct entry {
+  int code_value;
+  int parent_code;
+  char k;
+  int generation;
+} *table;
+static unsigned int table_size;
+static int generation;
+
+static void init_reference(int code_bits) {
+  unsigned int i;
+  for ( table_size = ( 1u << code_bits ) / 4 * 5 + 1 ; ; table_size += 2 ) {
+    for ( i = 3 ; i * i <= table_size && table_size % i ; i += 2 )
+      ;
+    if ( i * i > table_size )
+      break;
+  }
+  table = (struct entry *) malloc(table_size * sizeof(struct entry));
+  if ( !table ) {
+    fprintf(stderr, "lzw_dict_bench: memoria insuficiente\n");
+    exit(1);
+  }
+  for ( i = 0 ; i < table_size ; i++ )
+    table[ i ].code_value = -1;
+  generation = 0;
+}
+
+static unsigned int find_reference(int code_bits, int w, int k) {
+  unsigned int index = ( k << ( code_bits - 8 ) ) ^ w;
+  unsigned int offset = index == 0 ? 1 : table_size - index;
+  for ( ; ; ) {
+    if ( table[ index ].code_value == -1 ||
+	 table[ index ].generation != generation )
+      return index;
+    if ( table[ index ].parent_code == w && table[ index ].k == (char) k )
+      return index;
+    if ( index >= offset )
+      index -= offset;
+    else
+      index += table_size - offset;
+  }
+}
+
+/* Cada mtodo devuelve el nmero de cdigos emitidos, que debe
+   coincidir. */
+static unsigned long parse_reference(const unsigned char *data, size_t size,
+				     int code_bits) {
+  unsigned int max_code = ( 1u << code_bits ) - 1;
+  unsigned int next_w = FIRST_CODE;
+  unsigned long codes = 0;
+  unsigned int index;
+  size_t i;
+  int w = data[ 0 ];
+
+  init_reference(code_bits);
+  for ( i = 1 ; i < size ; i++ ) {
+    index = find_reference(code_bits, w, data[ i ]);
+    if ( table[ index ].code_value != -1 &&
+	 table[ index ].generation == generation ) {
+      w = table[ index ].code_value;
+      continue;
+    }
+    codes++;
+    table[ index ].code_value = next_w++;
+    table[ index ].parent_code = w;
+    table[ index ].k = (char) data[ i ];
+    table[ index ].generation = generation;
+    w = data[ i ];
+    if ( next_w > max_code ) {
+      generation++;
+      next_w = FIRST_CODE;
+    }
+  }
+  free(table);
+  return codes + 1;
+}
+
+static unsigned long parse_lzw_dict(const unsigned char *data, size_t size,
+				    int code_bits) {
+  unsigned int max_code = ( 1u << code_bits ) - 1;
+  unsigned int next_w = FIRST_CODE;
+  unsigned long codes = 0;
+  unsigned int key;
+  size_t i;
+  int w = data[ 0 ];
+  int code;
+
+  lzw_dict_init(code_bits);
+  for ( i = 1 ; i < size ; i++ ) {
+    key = LZW_KEY(w, data[ i ]);
+    if ( ( code = lzw_dict_find(key) ) >= 0 ) {
+      w = code;
+      continue;
+    }
+    codes++;
+    lzw_dict_add(key, next_w++);
+    w = data[ i ];
+    if ( next_w > max_code ) {
+      lzw_dict_reset();
+      next_w = FIRST_CODE;
+    }
+  }
+  return codes + 1;
+}
+
+static void run(const char *name, const unsigned char *data, size_t size,
+		int code_bits) {
+  static struct {
+    const char *name;
+    unsigned long (*parse)(const unsigned char *, size_t, int);
+  } methods[] = {
+    { "hash doble", parse_reference },
+    { "lzw_dict", parse_lzw_dict }
+  };
+  unsigned long codes, reference = 0;
+  double t, best;
+  int m, r;
+
+  for ( m = 0 ; m < 2 ; m++ ) {
+    best = 1e30;
+    for ( r = 0 ; r < REPETITIONS ; r++ ) {
+      t = now();
+      codes = methods[ m ].parse(data, size, code_bits);
+      t = now() - t;
+      if ( t < best )
+	best = t;
+    }
+    if ( m == 0 )
+      reference = codes;
+    else if ( codes != reference ) {
+      fprintf(stderr, "lzw_dict_bench: parsing errneo (%s)\n",
+	      methods[ m ].name);
+      exit(1);
+    }
+    printf("%-12s %-10s %10.1f M/s (%lu codigos)\n", name,
+	   methods[ m ].name, ( size - 1 ) / best / 1e6, codes);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  static const char *words[] = {
+    "the ", "of ", "and ", "to ", "in ", "is ", "that ", "for ",
+    "compression ", "dictionary ", "code ", "string ", "symbol ",
+    "window ", "stream ", "error ", "GET /index.html ", "200 ",
+    "404 ", "2024-01-01 ", "12:00:00 ", "user=", "id=", "\n"
+  };
+  size_t size = 16, i, n;
+  int code_bits = 15;
+  int j;
+  unsigned char *data;
+
+  if ( argc > 1 )
+    size = atoi(argv[ 1 ]);
+  if ( argc > 2 )
+    code_bits = atoi(argv[ 2 ]);
+  if ( code_bits < 9 || code_bits > LZW_MAX_CODE_BITS ) {
+    fprintf(stderr, "lzw_dict_bench: bits_codigo de 9 a %d\n",
+	    LZW_MAX_CODE_BITS);
+    exit(1);
+  }
+  size <<= 20;
+  data = malloc(size + 32);
+  if ( !data ) {
+    fprintf(stderr, "lzw_dict_bench: memoria insuficiente\n");
+    exit(1);
+  }
+
+  /* Texto: palabras de un vocabulario pequeo, con nmeros. */
+  srand(1);
+  for ( i = 0 ; i < size ; i += n ) {
+    if ( rand() % 4 ) {
+      j = rand() % 24;
+      n = strlen(words[ j ]);
+      memcpy(data + i, words[ j ], n);
+    } else
+      n = sprintf((char *) data + i, "%d ", rand() % 100000);
+  }
+  run("texto", data, size, code_bits);
+
+  /* Rachas cortas de unos pocos smbolos. */
+  for ( i = 0 ; i < size ; i++ )
+    data[ i ] = ( rand() & 7 ) ? ( i ? data[ i - 1 ] : 'a' ) : 'a' + rand() % 4;
+  run("rachas", data, size, code_bits);
+
+  for ( i = 0 ; i < size ; i++ )
+    data[ i ] = rand();
+  run("aleatorios", data, size, code_bits);
+
+  free(data);
+  return 0;
+}
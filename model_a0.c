@@ -11,6 +11,9 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitio.h"
 #include "vlc.h"
 #include "codec.h"
 
@@ -53,6 +56,24 @@ int symbol;
 /* Indice del smbolo codificado. */
 int _index;
 
+/* Con "-f", cada lnea (mensaje) termina en un punto de
+   sincronizacin: se codifica EOS y el codificador entrega todos los
+   bits pendientes alineados a byte, pero el modelo se conserva. As
+   el descodificador puede entregar cada mensaje en cuanto lo recibe,
+   sin esperar al siguiente. El code-stream comienza con un bit que
+   indica este modo, as que el descodificador no necesita la opcin;
+   si se le da y el stream no la us, termina con un error. */
+static int sync_flush;
+
+/* Procesa las opciones de la lnea de comandos. */
+static void parse_options(int argc, char *argv[]) {
+  int i;
+  for(i=2; i<argc; i++) {
+    if(strcmp(argv[i],"-f")==0)
+      sync_flush = 1;
+  }
+}
+
 /* Convierte un smbolo en un ndice. */
 int find_index(int symbol) {
   return symbol+1;
@@ -126,7 +147,9 @@ void finish_model() {
 /* Codifica el stream de datos que entra por la entrada estndar y
    produce el code-stream sobre la salida estndar. */
 void encode_stream(int argc, char *argv[]) {
+  parse_options(argc, argv);
   init_model();
+  put_bit(sync_flush);
   init_encoder();
   for(;;) {
     symbol = getchar();
@@ -134,20 +157,40 @@ void encode_stream(int argc, char *argv[]) {
     _index = find_index(symbol);
     encode_index(_index, cum_prob);
     update_model();
+    if(sync_flush && symbol=='\n') {
+      encode_index(find_index(EOS), cum_prob);
+      sync_encoder();
+    }
   }
   encode_index(find_index(EOS), cum_prob);
-  finish_encoder();
+  if(sync_flush) sync_encoder();
+  else finish_encoder();
   finish_model();
 }
 
 /* Realiza el proceso inverso a encode_stream(). */
 void decode_stream(int argc, char *argv[]) {
+  int c;
+  parse_options(argc, argv);
   init_model();
+  if(get_bit()) sync_flush = 1;
+  else if(sync_flush) {
+    fprintf(stderr,"model_a0: el code-stream no tiene puntos de sincronizacin (-f)\n");
+    exit(1);
+  }
   init_decoder();
   for(;;) {
     _index = decode_index(cum_prob);
     symbol = find_symbol(_index);
-    if(symbol==EOS) break;
+    if(symbol==EOS) {
+      if(!sync_flush) break;
+      /* Entregamos el mensaje antes de esperar al siguiente. */
+      fflush(stdout);
+      if((c = getchar())==EOF) break;
+      ungetc(c, stdin);
+      sync_decoder();
+      continue;
+    }
     putchar(symbol);
     update_model();
   }
@@ -0,0 +1,117 @@
+/*
+ * rice_ctx.c
+ *
+ * Un codificador de Rice con un parmetro adaptativo por contexto,
+ * pensado para secuencias de residuos de prediccin.
+ *
+ * Cada byte de entrada se interpreta como un residuo con signo (en
+ * complemento a dos) y se transforma en un entero no negativo
+ * (0,-1,1,-2,2,... -> 0,1,2,3,4,...). El contexto es la actividad
+ * local, cuantificada logartmicamente, de los dos residuos
+ * anteriores, de manera que las zonas tranquilas y las zonas activas
+ * de la secuencia usan parmetros distintos. Vase golomb_ctx.c.
+ *
+ * Referencias:
+ *
+ * R. F. Rice, "Some Practical Universal Noiseless Coding Techniques,
+ * " Jet Propulsion Laboratory, Pasadena, California, JPL Publication
+ * 79--22, Mar. 1979.
+ *
+ * M. J. Weinberger, G. Seroussi and G. Sapiro, "The LOCO-I Lossless
+ * Image Compression Algorithm: Principles and Standardization into
+ * JPEG-LS," IEEE Trans. Image Processing, vol. 9, no. 8,
+ * pp. 1309--1324, Aug. 2000.
+ */
+
+#include <stdio.h>
+#include "bitio.h"
+#include "golomb_ctx.h"
+#include "codec.h"
+
+/* Smbolo que indica el fin del stream. Los residuos ocupan los
+   valores 0..255. */
+#define EOS 256
+
+/* Nmero de bits con los que se enva un valor escapado. */
+#define QBITS 9
+
+/* Longitud mxima de un cdigo. */
+#define LIMIT 32
+
+/* Los recuentos de un contexto se dividen entre dos cada RESET
+   valores. */
+#define RESET 64
+
+/* La actividad (suma de dos valores transformados, 0..510) se
+   cuantifica en 10 niveles. */
+#define CONTEXTS 10
+
+static GOLOMB_CONTEXT contexts[CONTEXTS];
+
+/* Transforma un residuo con signo en un entero no negativo. */
+static int map_residual(int c) {
+  int e = (signed char)c;
+  return e >= 0 ? 2*e : -2*e - 1;
+}
+
+static int unmap_residual(int m) {
+  return (m & 1) ? -((m + 1) >> 1) : m >> 1;
+}
+
+/* Contexto asociado a los dos valores anteriores. */
+static int context(int m1, int m2) {
+  int activity = m1 + m2;
+  int q = 0;
+  while(activity) {
+    activity >>= 1;
+    q++;
+  }
+  return q;
+}
+
+static void init_contexts() {
+  int i;
+  for(i=0; i<CONTEXTS; i++)
+    init_golomb_context(&contexts[i], 4);
+}
+
+/* Codifica "m" en el contexto "ctx". */
+static void encode_value(int m, GOLOMB_CONTEXT *ctx) {
+  int k = golomb_parameter(ctx->N, ctx->A);
+  put_golomb(m, k, LIMIT, QBITS);
+  update_golomb_context(ctx, m, RESET);
+}
+
+static int decode_value(GOLOMB_CONTEXT *ctx) {
+  int k = golomb_parameter(ctx->N, ctx->A);
+  int m = get_golomb(k, LIMIT, QBITS);
+  update_golomb_context(ctx, m, RESET);
+  return m;
+}
+
+void encode_stream(int argc, char *argv[]) {
+  int c, m;
+  int m1 = 0, m2 = 0;
+  init_contexts();
+  while((c = getchar()) != EOF) {
+    m = map_residual(c);
+    encode_value(m, &contexts[context(m1, m2)]);
+    m2 = m1;
+    m1 = m;
+  }
+  encode_value(EOS, &contexts[context(m1, m2)]);
+  flush();
+}
+
+void decode_stream(int argc, char *argv[]) {
+  int m;
+  int m1 = 0, m2 = 0;
+  init_contexts();
+  for(;;) {
+    m = decode_value(&contexts[context(m1, m2)]);
+    if(m == EOS) break;
+    putchar(unmap_residual(m) & 0xFF);
+    m2 = m1;
+    m1 = m;
+  }
+}
@@ -0,0 +1,207 @@
+/*
+ * suffix_array.c
+ *
+ * Array de sufijos, array LCP y factores previos ms largos (LPF) de
+ * un buffer. Lo usan bwt.cpp, para ordenar los sufijos de cada
+ * bloque, y lzss.c ("-s"), para encontrar todas las cadenas de un
+ * bloque de una vez.
+ *
+ * El array de sufijos se construye por duplicacin de prefijos: tras
+ * la pasada "h" los sufijos estn ordenados por sus 2h primeros
+ * smbolos, y cada pasada es una ordenacin por cuentas (counting
+ * sort) de los pares de rangos de la pasada anterior. El coste es
+ * O(n log L), siendo L la longitud del prefijo comn ms largo entre
+ * dos sufijos, puesto que se termina en cuanto todos los rangos son
+ * distintos.
+ *
+ * Referencias:
+ *
+ * U. Manber and G. Myers, "Suffix Arrays: A New Method for On-Line
+ * String Searches," SIAM J. Computing, 22(5):935-948. 1993.
+ * T. Kasai, G. Lee, H. Arimura, S. Arikawa and K. Park, "Linear-Time
+ * Longest-Common-Prefix Computation in Suffix Arrays and Its
+ * Applications," CPM 2001, LNCS 2089, pp. 181-192. 2001.
+ * M. Crochemore and L. Ilie, "Computing Longest Previous Factor in
+ * linear time and applications," Information Processing Letters,
+ * 106(2):75-80. 2008.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "suffix_array.h"
+
+static void *allocate(size_t size) {
+  void *p = malloc(size);
+  if ( !p ) {
+    fprintf(stderr, "suffix_array: out of memory\n");
+    exit(1);
+  }
+  return p;
+}
+
+/* Rango del segundo elemento del par de la posicin "i" en la
+   pasada "h". El final del buffer (-1) slo se compara por
+   igualdad. */
+#define SECOND_RANK(i) ( (i) + h < n ? rank[ (i) + h ] : -1 )
+
+/*
+ * Ordena los "n" sufijos de "data". "sa[r]" es la posicin en la que
+ * comienza el sufijo de orden "r".
+ */
+void suffix_array(const unsigned char *data, int n, int *sa, int end_order) {
+  int *rank;
+  int *second;
+  int *count;
+  int *swap;
+  int ranks;
+  int h;
+  int i;
+  int k;
+  int r;
+
+  if ( n <= 0 )
+    return;
+  rank = (int *) allocate(n*sizeof(int));
+  second = (int *) allocate(n*sizeof(int));
+  count = (int *) allocate(((n > 256 ? n : 256) + 1)*sizeof(int));
+
+  /* Pasada inicial: los sufijos se ordenan por su primer smbolo, y
+     el rango de cada uno es el smbolo ms 1. */
+  memset(count, 0, 257*sizeof(int));
+  for ( i = 0 ; i < n ; i++ )
+    count[ data[ i ] + 1 ]++;
+  for ( r = 1 ; r <= 256 ; r++ )
+    count[ r ] += count[ r - 1 ];
+  for ( i = 0 ; i < n ; i++ ) {
+    sa[ count[ data[ i ] ]++ ] = i;
+    rank[ i ] = data[ i ] + 1;
+  }
+  ranks = 256;
+
+  for ( h = 1 ; ; h *= 2 ) {
+    /* Orden de los sufijos por el segundo elemento del par: el de
+       los sufijos "sa[r] - h" en el orden actual, con los que llegan
+       al final del buffer al principio o al final. */
+    k = 0;
+    if ( end_order == END_SMALLEST )
+      for ( i = n - h ; i < n ; i++ )
+	if ( i >= 0 )
+	  second[ k++ ] = i;
+    for ( r = 0 ; r < n ; r++ )
+      if ( sa[ r ] >= h )
+	second[ k++ ] = sa[ r ] - h;
+    if ( end_order == END_LARGEST )
+      for ( i = n - h ; i < n ; i++ )
+	if ( i >= 0 )
+	  second[ k++ ] = i;
+
+    /* Ordenacin estable por el primer elemento del par. */
+    memset(count, 0, (ranks + 1)*sizeof(int));
+    for ( i = 0 ; i < n ; i++ )
+      count[ rank[ i ] ]++;
+    for ( r = 1 ; r <= ranks ; r++ )
+      count[ r ] += count[ r - 1 ];
+    for ( k = n - 1 ; k >= 0 ; k-- )
+      sa[ --count[ rank[ second[ k ] ] ] ] = second[ k ];
+
+    /* Nuevos rangos (en "second", que ya no se necesita). */
+    second[ sa[ 0 ] ] = ranks = 1;
+    for ( r = 1 ; r < n ; r++ ) {
+      if ( rank[ sa[ r ] ] != rank[ sa[ r - 1 ] ] ||
+	   SECOND_RANK( sa[ r ] ) != SECOND_RANK( sa[ r - 1 ] ) )
+	ranks++;
+      second[ sa[ r ] ] = ranks;
+    }
+    swap = rank;
+    rank = second;
+    second = swap;
+    if ( ranks == n )
+      break;
+  }
+  free(rank);
+  free(second);
+  free(count);
+}
+
+/*
+ * Calcula "lcp[r]", la longitud del prefijo comn de los sufijos
+ * "sa[r - 1]" y "sa[r]" (lcp[0] = 0), en tiempo lineal: si el sufijo
+ * "i" comparte "l" smbolos con su anterior en el array, el sufijo
+ * "i + 1" comparte al menos "l - 1" con el suyo.
+ */
+void lcp_array(const unsigned char *data, int n, const int *sa, int *lcp) {
+  int *rank;
+  int i;
+  int j;
+  int l;
+
+  if ( n <= 0 )
+    return;
+  rank = (int *) allocate(n*sizeof(int));
+  for ( i = 0 ; i < n ; i++ )
+    rank[ sa[ i ] ] = i;
+  lcp[ 0 ] = 0;
+  l = 0;
+  for ( i = 0 ; i < n ; i++ ) {
+    if ( rank[ i ] == 0 ) {
+      l = 0;
+      continue;
+    }
+    j = sa[ rank[ i ] - 1 ];
+    while ( i + l < n && j + l < n && data[ i + l ] == data[ j + l ] )
+      l++;
+    lcp[ rank[ i ] ] = l;
+    if ( l > 0 )
+      l--;
+  }
+  free(rank);
+}
+
+/*
+ * Calcula, para cada posicin "i", la longitud "length[i]" de la
+ * cadena ms larga que comienza en "i" y tambin en una posicin
+ * anterior "source[i]" (las dos cadenas pueden solaparse). Si no
+ * existe, length[i] = 0.
+ *
+ * Los candidatos son los sufijos anteriores a "i" ms prximos en el
+ * array de sufijos, por la izquierda y por la derecha. Se recorre el
+ * array con una pila de sufijos de posicin creciente: al sacar un
+ * sufijo, el de debajo es su candidato izquierdo y el que lo saca, el
+ * derecho. "lcp" se modifica: lcp[r] pasa a ser el prefijo comn de
+ * "sa[r]" con el sufijo de debajo en la pila.
+ */
+void longest_previous_factor(const int *sa, int *lcp, int n,
+			     int *length, int *source) {
+  int *stack;
+  int top;
+  int t;
+  int r;
+  int l;
+
+  if ( n <= 0 )
+    return;
+  stack = (int *) allocate(n*sizeof(int));
+  top = 0;
+  stack[ 0 ] = 0;
+  for ( r = 1 ; r <= n ; r++ ) {
+    l = r < n ? lcp[ r ] : 0;
+    while ( top >= 0 && ( r == n || sa[ r ] < sa[ stack[ top ] ] ) ) {
+      t = stack[ top-- ];
+      if ( lcp[ t ] >= l ) {
+	length[ sa[ t ] ] = lcp[ t ];
+	source[ sa[ t ] ] = top >= 0 ? sa[ stack[ top ] ] : -1;
+      } else {
+	length[ sa[ t ] ] = l;
+	source[ sa[ t ] ] = sa[ r ];
+      }
+      if ( lcp[ t ] < l )
+	l = lcp[ t ];
+    }
+    if ( r < n ) {
+      lcp[ r ] = top >= 0 ? l : 0;
+      stack[ ++top ] = r;
+    }
+  }
+  free(stack);
+}
@@ -0,0 +1,25 @@
+/*
+ * suffix_array.h
+ *
+ * Array de sufijos, array LCP y factores previos ms largos (LPF) de
+ * un buffer.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Orden del final del buffer respecto de los bytes: un sufijo que es
+   prefijo de otro va antes (END_SMALLEST, el orden lexicogrfico
+   habitual) o despus (END_LARGEST, como en bwt.cpp). */
+#define END_SMALLEST 0
+#define END_LARGEST 1
+
+void suffix_array(const unsigned char *data, int n, int *sa, int end_order);
+void lcp_array(const unsigned char *data, int n, const int *sa, int *lcp);
+void longest_previous_factor(const int *sa, int *lcp, int n,
+			     int *length, int *source);
+
+#ifdef __cplusplus
+}
+#endif
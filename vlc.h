@@ -4,3 +4,5 @@ void   encode_index(int index, unsigned short *cum_counts);
 int    decode_index(unsigned short *cum_counts);
 void finish_encoder();
 void finish_decoder();
+void sync_encoder();
+void sync_decoder();